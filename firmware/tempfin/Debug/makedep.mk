@@ -2,12 +2,16 @@
 # Automatically-generated file. Do not edit or delete the file
 ################################################################################
 
+alarm.c
+
 config.c
 
 config_app.c
 
 config_textmode.c
 
+evlog.c
+
 heater.c
 
 json_parser.c
@@ -16,6 +20,10 @@ kinen.c
 
 main.c
 
+print.c
+
+profiler.c
+
 report.c
 
 sensor.c
@@ -26,6 +34,8 @@ util.c
 
 xio\xio.c
 
+xio\xio_rs485.c
+
 xio\xio_spi.c
 
 xio\xio_usart.c
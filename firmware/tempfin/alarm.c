@@ -0,0 +1,105 @@
+/*
+ * alarm.c - threshold alarms over config values
+ * Part of Kinen project
+ *
+ * Copyright (c) 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <avr/pgmspace.h>
+
+#include "kinen.h"
+#include "config.h"
+#include "alarm.h"
+#include "print.h"
+#include "xio/xio.h"
+
+static uint8_t _al_test(alRule_t *r, double value, uint8_t fired);
+static void _al_message(uint8_t n, double value);
+
+/*
+ * al_init() - all rules off
+ */
+void al_init()
+{
+	memset(&al, 0, sizeof(alarm_t));
+}
+
+/*
+ * al_callback() - evaluate the rules. Called from the 100 ms tick
+ */
+void al_callback()
+{
+	cmdObj_t cmd;
+
+	for (uint8_t n=0; n<AL_RULES; n++) {
+		alRule_t *r = &al.rule[n];
+		if (r->op == AL_OFF) { continue;}
+
+		cmd.pv = NULL;					// a standalone object - cmd_reset_obj() looks at pv
+		cmd.index = r->index;
+		cmd_get_cmdObj(&cmd);
+
+		if (r->fired == true) {
+			if (_al_test(r, cmd.value, true) == false) {
+				r->fired = false;
+				r->timer = 0;
+			}
+			continue;
+		}
+		if (_al_test(r, cmd.value, false) == false) {
+			r->timer = 0;
+			continue;
+		}
+		r->timer += AL_TICK_SECONDS;
+		if (r->timer >= r->hold) {
+			r->fired = true;
+			_al_message(n, cmd.value);
+		}
+	}
+}
+
+/*
+ * _al_test() - true if the rule's condition is met
+ *
+ *	Once a rule has fired the condition is met until the value is past the 
+ *	hysteresis margin, so a noisy value doesn't fire it over and over.
+ */
+static uint8_t _al_test(alRule_t *r, double value, uint8_t fired)
+{
+	double margin = (fired == true) ? r->hysteresis : 0;
+
+	switch (r->op) {
+		case AL_ABOVE:	 return ((value > (r->threshold - margin)) ? true : false);
+		case AL_BELOW:	 return ((value < (r->threshold + margin)) ? true : false);
+		case AL_WITHIN:	 return ((fabs(value - r->threshold) <= (r->band + margin)) ? true : false);
+		case AL_OUTSIDE: return ((fabs(value - r->threshold) > (r->band - margin)) ? true : false);
+	}
+	return (false);
+}
+
+static void _al_message(uint8_t n, double value)
+{
+	char buf[PRINT_FLOAT_LEN];
+
+	xio_set_priority(AL_STREAM, true);
+	print_str_P(AL_STREAM, PSTR("{\"al\":["));
+	print_ftoa(buf, n, 0);
+	print_str(AL_STREAM, buf);
+	print_str_P(AL_STREAM, PSTR(","));
+	print_ftoa(buf, value, 3);
+	print_str(AL_STREAM, buf);
+	print_str_P(AL_STREAM, PSTR("]}\n"));
+	xio_set_priority(AL_STREAM, false);
+}
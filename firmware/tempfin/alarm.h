@@ -0,0 +1,85 @@
+/*
+ * alarm.h - threshold alarms over config values
+ * Part of Kinen project
+ *
+ * Copyright (c) 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* --- How it works ---
+ *
+ *	Each rule watches one cfgArray value by its index - any plain number (a 
+ *	_get_dbl, _get_ui8 or _get_int getter), e.g. h1tmp or p1out. Every 100 ms 
+ *	al_callback() reads the value and tests it:
+ *
+ *	  AL_ABOVE		fires when value > threshold, clears below threshold - hysteresis
+ *	  AL_BELOW		fires when value < threshold, clears above threshold + hysteresis
+ *	  AL_WITHIN		fires when value is within +/- band of threshold, 
+ *					clears outside +/- (band + hysteresis)
+ *	  AL_OUTSIDE	fires when value is outside +/- band of threshold, 
+ *					clears inside +/- (band - hysteresis)
+ *
+ *	The condition must hold for the hold time before the rule fires. When it fires 
+ *	it prints one {"al":[rule,value]} line on the response stream and stays quiet 
+ *	until it has cleared. On a slave that's SPI, where it raises data ready.
+ *
+ *	Rules are set up through the "al" group. alid selects the rule that alix 
+ *	(cfgArray index), alop (AL_ op), alth (threshold), albw (band half width), 
+ *	alhy (hysteresis), alhd (hold seconds) and alst (1 if fired, read-only) 
+ *	refer to. Setting alix or 
+ *	alop re-arms the rule.
+ */
+#ifndef alarm_h
+#define alarm_h
+
+/******************************************************************************
+ * PARAMETERS AND SETTINGS
+ ******************************************************************************/
+
+#define AL_RULES			4			// number of alarm rules
+#define AL_TICK_SECONDS		0.1			// al_callback() runs from the 100 ms tick
+#define AL_STREAM			stderr		// alarms go out on the response stream
+
+enum alOp {								// comparisons
+	AL_OFF = 0,							// rule is not evaluated
+	AL_ABOVE,
+	AL_BELOW,
+	AL_WITHIN,
+	AL_OUTSIDE
+};
+
+/******************************************************************************
+ * STRUCTURES
+ ******************************************************************************/
+
+typedef struct AlarmRule {
+	index_t index;				// cfgArray index of the watched value
+	uint8_t op;					// see enum alOp
+	uint8_t fired;				// rule has fired and not cleared yet
+	double threshold;			// threshold, or centre of the band for WITHIN and OUTSIDE
+	double band;				// half width of the band for WITHIN and OUTSIDE
+	double hysteresis;			// clear margin past the threshold or band edge
+	double hold;				// seconds the condition must hold before firing
+	double timer;				// seconds the condition has held so far
+} alRule_t;
+
+typedef struct Alarm {
+	uint8_t select;				// rule selected by alid
+	alRule_t rule[AL_RULES];
+} alarm_t;
+alarm_t al;						// alarms are a singleton
+
+/******************************************************************************
+ * FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+void al_init(void);
+void al_callback(void);
+
+#endif
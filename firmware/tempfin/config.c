@@ -15,7 +15,7 @@
 /*	See config_app.h for an overview of the config system and it's use.
  */
 //#include <ctype.h>
-//#include <stdlib.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -27,6 +27,7 @@
 #include "config_app.h"		// application-specific config stuff - follows config.h
 #include "json_parser.h"
 #include "util.h"
+#include "print.h"
 #include "xio/xio.h"
 //#include "report.h"
 //#include "system.h"
@@ -51,19 +52,33 @@ static uint8_t _set_defa(cmdObj_t *cmd);	// reset config to default values
  * cmd_get() 	- Build a cmdObj with the values from the target & return the value
  *			   	  Populate cmd body with single valued elements or groups (iterates)
  * cmd_persist()- persist value to NVM. Takes special cases into account
+ * cmd_index_is_cacheable() - true if the group's response can be cached (F_CACHE)
+ *
+ *	Every set drops the cached group response, not just sets into that group. 
+ *	A set can have side effects on other groups (h1st turns the sensor on, for 
+ *	example) and one compare is cheaper than working out which groups it touched.
  */
 uint8_t cmd_set(cmdObj_t *cmd)
 {
-	ritorno(cmd_index_lt_max(cmd->index));	// validate index or return
+	if (cmd_index_lt_max(cmd->index) == false) { return (SC_INTERNAL_RANGE_ERROR);}
+#ifdef __JSON_CACHE
+	js_cache_invalidate();
+#endif
 	return (((fptrCmd)(pgm_read_word(&cfgArray[cmd->index].set)))(cmd));
 }
 
 uint8_t cmd_get(cmdObj_t *cmd)
 {
-	ritorno(cmd_index_lt_max(cmd->index));	// validate index or return
+	if (cmd_index_lt_max(cmd->index) == false) { return (SC_INTERNAL_RANGE_ERROR);}
 	return (((fptrCmd)(pgm_read_word(&cfgArray[cmd->index].get)))(cmd));
 }
 
+uint8_t cmd_index_is_cacheable(index_t index)
+{
+	if (cmd_index_is_group(index) == false) { return (false);}
+	return ((pgm_read_byte(&cfgArray[index].flags) & F_CACHE) ? true : false);
+}
+
 void cmd_persist(cmdObj_t *cmd)
 {
 #ifdef __ENABLE_PERSISTENCE	
@@ -228,6 +243,164 @@ uint8_t _set_grp(cmdObj_t *cmd)
 	return (SC_OK);
 }
 
+/*
+ * Stored queries
+ *
+ * _set_qry() - define a stored query from an array of tokens and return its values
+ * _get_qry() - get the values of a stored query as an array
+ *
+ *	A master that asks for the same values every cycle can register the token 
+ *	list once, e.g. {"q1":["h1tmp","s1tmp","h1st"]}, then fetch them all with 
+ *	{"q1":null}. The tokens are resolved to cfgArray indexes when the query is 
+ *	defined, so the fetch does no cmd_get_index() lookups. The answer is the 
+ *	values in the order given, e.g. {"q1":[123.456,120.000,3]}. 
+ *
+ *	A query holds up to CMD_QUERY_LEN tokens. Its values go in the shared string, 
+ *	so a fetch whose values don't fit fails with SC_BUFFER_FULL. The response is 
+ *	longer than a TX lane and is sent whole by xio_write_tx()'s wait.
+ *
+ *	An empty array clears the query. Only plain values (_get_dbl, _get_ui8 and 
+ *	_get_int getters) can be part of a query - not groups, other queries or 
+ *	getters like evl and sch that start something. Queries are not persisted - a master must define them again after 
+ *	a reset.
+ */
+static cmdQuery_t *_get_query(cmdObj_t *cmd)
+{
+	return (&cmd_query[pgm_read_byte(&cfgArray[cmd->index].token[1]) - '1']);
+}
+
+uint8_t _set_qry(cmdObj_t *cmd)
+{
+	index_t index[CMD_QUERY_LEN];
+	uint8_t count = 0;
+	char *str, *end;
+
+	if (cmd->type != TYPE_ARRAY) { return (SC_INPUT_VALUE_UNSUPPORTED);}
+	for (str = *cmd->stringp; *str != NUL; str = end+1) {	// resolve all tokens before changing the query
+		if ((end = strchr(str, ',')) != NULL) { *end = NUL;}
+		if (count >= CMD_QUERY_LEN) { return (SC_INPUT_VALUE_TOO_LARGE);}
+		if (strlen(str) > CMD_TOKEN_LEN) { return (SC_UNRECOGNIZED_COMMAND);}
+		if ((index[count] = cmd_get_index("", str)) == NO_MATCH) { return (SC_UNRECOGNIZED_COMMAND);}
+		fptrCmd get = (fptrCmd)pgm_read_word(&cfgArray[index[count]].get);
+		if ((get != _get_dbl) && (get != _get_ui8) && (get != _get_int)) {	// plain values only
+			return (SC_INPUT_VALUE_UNSUPPORTED);
+		}
+		count++;
+		if (end == NULL) { break;}
+	}
+	cmdQuery_t *q = _get_query(cmd);
+	memcpy(q->index, index, count * sizeof(index_t));
+	q->count = count;
+	cmdStr.wp = (char *)cmd->stringp - cmdStr.string;	// the token list is no longer needed (it's the last string)
+	return (_get_qry(cmd));
+}
+
+/*
+ *	The values are written straight into the shared string. While the getters 
+ *	run all of the shared string is claimed, so a getter can't copy a string 
+ *	over the values. 
+ */
+uint8_t _get_qry(cmdObj_t *cmd)
+{
+	cmdQuery_t *q = _get_query(cmd);
+	cmdObj_t obj;
+	char buf[PRINT_FLOAT_LEN];
+	uint8_t wp = cmdStr.wp;
+	char *str = &cmdStr.string[wp];
+	uint8_t status = SC_OK;
+
+	cmdStr.wp = CMD_SHARED_STRING_LEN;
+	*str = NUL;
+	for (uint8_t i=0; i<q->count; i++) {
+		obj.pv = NULL;
+		cmd_reset_obj(&obj);
+		obj.index = q->index[i];
+		if ((status = cmd_get(&obj)) != SC_OK) { break;}
+		uint8_t len = print_ftoa(buf, obj.value, (obj.type == TYPE_FLOAT) ? 3 : 0) - buf;
+		if ((str + len + 1) > &cmdStr.string[CMD_SHARED_STRING_LEN-1]) {	// comma, value and NUL
+			status = SC_BUFFER_FULL;
+			break;
+		}
+		if (i != 0) { *str++ = ',';}
+		str = print_strcpy(str, buf);
+	}
+	cmdStr.wp = wp;
+	if (status != SC_OK) { return (status);}
+
+	cmd->stringp = (char (*)[])&cmdStr.string[wp];
+	cmdStr.wp += strlen(*cmd->stringp) + 1;
+	if (cmdStr.wp > cmdStr.wp_hwm) { cmdStr.wp_hwm = cmdStr.wp;}
+	cmd->value = q->count;
+	cmd->type = TYPE_ARRAY;
+	return (SC_OK);
+}
+
+/*
+ * Schema discovery
+ *
+ * _get_sch() 			 - start streaming the schema. Returns the number of entries
+ * cmd_schema_callback() - write the next schema line when there is room for it
+ *
+ *	{"sch":null} lets a client learn the config table without knowing cfgArray. 
+ *	The answer is the entry count. Then one line per entry follows on the same 
+ *	stream, from the main loop: {"#":[index,"group","token",type,flags]}.
+ *	Type is an objType, or TYPE_EMPTY if it's set by a custom getter when the 
+ *	value is read. Flags are the F_ flags. Any entry can then be addressed as 
+ *	"#index" (see cmd_get_index_direct()).
+ *
+ *	A line is only started when the whole of it fits in the TX buffer, so no
+ *	characters are dropped however slowly the stream is read.
+ */
+static index_t schema_next = NO_MATCH;		// next entry to stream (NO_MATCH if not streaming)
+
+static uint8_t _get_type(index_t i)
+{
+	fptrCmd get = (fptrCmd)pgm_read_word(&cfgArray[i].get);
+
+	if (get == _get_grp) { return (TYPE_PARENT);}
+	if (get == _get_dbl) { return (TYPE_FLOAT);}
+	if ((get == _get_ui8) || (get == _get_int)) { return (TYPE_INTEGER);}
+	if (get == _get_qry) { return (TYPE_ARRAY);}
+	if (get == _get_nul) { return (TYPE_NULL);}
+	return (TYPE_EMPTY);
+}
+
+uint8_t _get_sch(cmdObj_t *cmd)
+{
+	index_t count = 0;
+	while (cmd_index_lt_max(count)) { count++;}
+	schema_next = 0;
+	cmd->value = count;
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+uint8_t cmd_schema_callback()
+{
+	char buf[PRINT_FLOAT_LEN];
+	index_t i = schema_next;
+
+	if (cmd_index_lt_max(i) == false) { return (SC_NOOP);}
+	if (xio_tx_room(stderr) < CMD_SCHEMA_LINE_LEN) { return (SC_NOOP);}
+	schema_next++;
+
+	print_str_P(stderr, PSTR("{\"#\":["));
+	print_ftoa(buf, i, 0);
+	print_str(stderr, buf);
+	print_str_P(stderr, PSTR(",\""));
+	print_str_P(stderr, cfgArray[i].group);
+	print_str_P(stderr, PSTR("\",\""));
+	print_str_P(stderr, cfgArray[i].token);
+	print_str_P(stderr, PSTR("\","));
+	print_ftoa(buf, _get_type(i), 0);
+	print_str(stderr, buf);
+	print_str_P(stderr, PSTR(","));
+	print_ftoa(buf, pgm_read_byte(&cfgArray[i].flags), 0);
+	print_str(stderr, buf);
+	print_str_P(stderr, PSTR("]}\n"));
+	return (SC_OK);
+}
+
 /*
  * cmd_group_is_prefixed() - hack
  *
@@ -287,6 +460,24 @@ index_t cmd_get_index(const char *group, const char *token)
 	}
 	return (NO_MATCH);
 }
+
+/*
+ * cmd_get_index_direct() - get the index from a "#N" token without a table scan
+ *
+ *	N is the cfgArray index (see the "sch" command for the table). The token is 
+ *	replaced by the item's mnemonic, so the command runs and answers exactly as 
+ *	if the mnemonic had been sent. Returns NO_MATCH if N isn't a valid index.
+ */
+index_t cmd_get_index_direct(char *token)
+{
+	char *end;
+	long n = strtol(&token[1], &end, 10);
+
+	if ((end == &token[1]) || (*end != NUL) || (n < 0) || (n >= NO_MATCH)) { return (NO_MATCH);}
+	if (cmd_index_lt_max((index_t)n) == false) { return (NO_MATCH);}
+	strcpy_P(token, cfgArray[n].token);
+	return ((index_t)n);
+}
 /*
  * cmdObj low-level object and list operations
  * cmd_get_cmdObj()		- setup a cmd object by providing the index
@@ -312,7 +503,7 @@ index_t cmd_get_index(const char *group, const char *token)
 
 void cmd_get_cmdObj(cmdObj_t *cmd)
 {
-	if (cmd_index_lt_max(cmd->index)) { return;}
+	if (cmd_index_lt_max(cmd->index) == false) { return;}
 	index_t tmp = cmd->index;
 	cmd_reset_obj(cmd);
 	cmd->index = tmp;
@@ -379,6 +570,7 @@ uint8_t cmd_copy_string(cmdObj_t *cmd, const char *src)
 	char *dst = &cmdStr.string[cmdStr.wp];
 	strcpy(dst, src);						// copy string to current head position
 	cmdStr.wp += strlen(src)+1;				// advance head for next string
+	if (cmdStr.wp > cmdStr.wp_hwm) { cmdStr.wp_hwm = cmdStr.wp;}
 	cmd->stringp = (char (*)[])dst;
 	return (SC_OK);
 }
@@ -458,7 +650,8 @@ cmdObj_t *cmd_add_string(char *token, const char *string)	// add a string object
 cmdObj_t *cmd_add_string_P(char *token, const char *string)
 {
 	char message[CMD_MESSAGE_LEN]; 
-	sprintf_P(message, string);
+	strncpy_P(message, string, CMD_MESSAGE_LEN-1);
+	message[CMD_MESSAGE_LEN-1] = NUL;
 	return(cmd_add_string(token, message));
 }
 
@@ -470,7 +663,8 @@ cmdObj_t *cmd_add_message(const char *string)	// conditionally add a message obj
 cmdObj_t *cmd_add_message_P(const char *string)	// conditionally add a message object to the body
 {
 	char message[CMD_MESSAGE_LEN]; 
-	sprintf_P(message, string);
+	strncpy_P(message, string, CMD_MESSAGE_LEN-1);
+	message[CMD_MESSAGE_LEN-1] = NUL;
 	return(cmd_add_string("msg", message));
 }
 
@@ -505,6 +699,13 @@ void cmd_print_list(uint8_t status, uint8_t text_flags, uint8_t json_flags)
 
 void cmd_print_list(uint8_t status, uint8_t text_flags, uint8_t json_flags)
 {
+	uint8_t used = 0;						// record body usage before it's printed
+	cmdObj_t *cmd = cmd_body;
+	for (uint8_t i=0; i<CMD_BODY_LEN; i++, cmd++) {
+		if (cmd->type != TYPE_EMPTY) { used = i+1;}
+	}
+	if (used > cmd_body_hwm) { cmd_body_hwm = used;}
+
 	if (kc.comm_mode == JSON_MODE) {
 		switch (json_flags) {
 			case JSON_NO_PRINT: { break; } 
@@ -80,9 +80,12 @@ typedef uint8_t index_t;			// use this if there are < 256 indexed objects
 #define CMD_MESSAGE_LEN 80			// sufficient space to contain end-user messages
 
 									// pre-allocated defines (take RAM permanently)
-#define CMD_SHARED_STRING_LEN 80	// shared string for string values
+#define CMD_SHARED_STRING_LEN 80	// shared string for string values (and a stored query's values)
 #define CMD_BODY_LEN 16				// body elements - allow for 1 parent + N children
 									// (each body element takes 23 bytes of RAM)
+#define CMD_QUERIES 2				// stored queries q1 - qN (see _get_qry())
+#define CMD_QUERY_LEN 8				// tokens per stored query - 8 values like -123.456 fit the shared string
+#define CMD_SCHEMA_LINE_LEN 30		// longest schema line incl. LF (see cmd_schema_callback())
 
 // Stuff you probably don't want to change 
 
@@ -156,17 +159,20 @@ enum srVerbosity {					// status report enable and verbosity
 #define F_INITIALIZE	0x01			// initialize this item (run set during initialization)
 #define F_PERSIST 		0x02			// persist this item when set is run
 #define F_NOSTRIP		0x04			// do not strip the group prefix from the token
+#define F_CACHE			0x08			// group response can be cached for a tick (see json_parser.h)
 #define _f00			0x00
 #define _fin			F_INITIALIZE
 #define _fpe			F_PERSIST
 #define _fip			(F_INITIALIZE | F_PERSIST)
 #define _fns			F_NOSTRIP
 #define _f07			(F_INITIALIZE | F_PERSIST | F_NOSTRIP)
+#define _fca			F_CACHE
 
 /**** Structures ****/
 
 typedef struct cmdString {				// shared string object
 	uint8_t wp;							// current string array index for len < 256 bytes
+	uint8_t wp_hwm;						// high-water mark of wp
 //	uint16_t wp;						// use this value is string len > 255 bytes
 	char string[CMD_SHARED_STRING_LEN];
 } cmdStr_t;
@@ -200,12 +206,19 @@ typedef struct cfgItem {
 	double def_value;					// default value for config item
 } cfgItem_t;
 
+typedef struct cmdQuery {				// stored query - a list of pre-resolved cfgArray indexes
+	uint8_t count;						// number of indexes in the query (0 = not defined)
+	index_t index[CMD_QUERY_LEN];
+} cmdQuery_t;
+
 /**** static allocation and definitions ****/
 
 cmdStr_t cmdStr;
 cmdObj_t cmd_list[CMD_LIST_LEN];		// JSON header element
 #define cmd_header cmd_list
 #define cmd_body  (cmd_list+1)
+uint8_t cmd_body_hwm;					// high-water mark of objects used in the body
+cmdQuery_t cmd_query[CMD_QUERIES];		// stored queries
 
 /**** Global scope function prototypes ****/
 
@@ -217,9 +230,11 @@ uint8_t cmd_set(cmdObj_t *cmd);			// main entry point for set value
 
 // helpers
 index_t cmd_get_index(const char *group, const char *token);
+index_t cmd_get_index_direct(char *token);
 uint8_t cmd_index_lt_max(index_t index);
 uint8_t cmd_index_is_single(index_t index);
 uint8_t cmd_index_is_group(index_t index);
+uint8_t cmd_index_is_cacheable(index_t index);
 uint8_t cmd_index_lt_groups(index_t index);
 uint8_t cmd_group_is_prefixed(char *group);
 
@@ -241,6 +256,10 @@ uint8_t _set_dbl(cmdObj_t *cmd);		// set double value
 
 uint8_t _set_grp(cmdObj_t *cmd);		// set data for a group
 uint8_t _get_grp(cmdObj_t *cmd);		// get data for a group
+uint8_t _set_qry(cmdObj_t *cmd);		// define a stored query and get it
+uint8_t _get_qry(cmdObj_t *cmd);		// get the values of a stored query
+uint8_t _get_sch(cmdObj_t *cmd);		// start streaming the schema
+uint8_t cmd_schema_callback(void);		// stream the next schema line
 
 // object and list functions
 void cmd_get_cmdObj(cmdObj_t *cmd);
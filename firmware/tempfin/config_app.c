@@ -96,7 +96,7 @@
 //#include <ctype.h>
 //#include <stdlib.h>
 //#include <string.h>
-//#include <stdio.h>
+#include <stdio.h>					// precursor for xio.h
 #include <stdbool.h>
 #include <avr/pgmspace.h>
 
@@ -106,6 +106,11 @@
 #include "config_app.h"
 #include "heater.h"
 #include "sensor.h"
+#include "system.h"
+#include "profiler.h"
+#include "evlog.h"
+#include "alarm.h"
+#include "xio/xio.h"
 
 /***********************************************************************************
  **** PROGRAM MEMORY STRINGS AND STRING ARRAYS *************************************
@@ -128,6 +133,70 @@ const char fmt_hv[] PROGMEM = "[hv]  hardware version%16.2f\n";
 
 #endif // __ENABLE_TEXTMODE
 
+/***********************************************************************************
+ **** APPLICATION-SPECIFIC FUNCTION PROTOTYPES *************************************
+ ***********************************************************************************/
+
+static uint8_t _get_upt(cmdObj_t *cmd);	// get uptime seconds or milliseconds (atomic read)
+static uint8_t _set_sync(cmdObj_t *cmd);	// align tick phase to the last broadcast LF
+#ifdef __XIO_RS485
+static uint8_t _set_rsad(cmdObj_t *cmd);	// set RS-485 node address
+#endif
+
+static uint8_t _set_h1ovr(cmdObj_t *cmd);	// set overheat temperature and hardware cutoff
+#ifndef __KINEN_MASTER
+static uint8_t _set_drdy(cmdObj_t *cmd);	// enable or disable the SPI data ready line
+#endif
+static uint8_t _get_evl(cmdObj_t *cmd);		// start printing the event log and return the record count
+
+static uint8_t _set_alid(cmdObj_t *cmd);	// select alarm rule
+static uint8_t _get_al(cmdObj_t *cmd);		// get a field of the selected alarm rule
+static uint8_t _set_al(cmdObj_t *cmd);		// set a field of the selected alarm rule
+
+static uint8_t _get_memfs(cmdObj_t *cmd);	// get minimum free stack
+static uint8_t _get_memur(cmdObj_t *cmd);	// get USART RX ring high-water mark
+static uint8_t _get_memut(cmdObj_t *cmd);	// get USART TX ring high-water mark
+static uint8_t _get_memsr(cmdObj_t *cmd);	// get SPI RX ring high-water mark
+static uint8_t _get_memst(cmdObj_t *cmd);	// get SPI TX ring high-water mark
+
+static uint8_t _set_xioid(cmdObj_t *cmd);	// select xio device for statistics readout
+static uint8_t _get_xiorb(cmdObj_t *cmd);	// get RX bytes
+static uint8_t _get_xiotb(cmdObj_t *cmd);	// get TX bytes
+static uint8_t _get_xiord(cmdObj_t *cmd);	// get RX drops
+static uint8_t _get_xiotd(cmdObj_t *cmd);	// get TX drops
+static uint8_t _get_xioov(cmdObj_t *cmd);	// get RX hardware overruns
+static uint8_t _get_xioll(cmdObj_t *cmd);	// get lines too long
+static uint8_t _get_xioet(cmdObj_t *cmd);	// get idle ETX count
+static uint8_t _set_xiors(cmdObj_t *cmd);	// reset statistics for selected device
+static uint8_t xio_select;					// device selected by xioid
+
+#ifdef __KINEN_MASTER
+static uint8_t _set_kmid(cmdObj_t *cmd);	// select slave for aggregate table readout
+static uint8_t _get_kmsl(cmdObj_t *cmd);	// get slave state
+static uint8_t _get_kmtmp(cmdObj_t *cmd);	// get slave temperature
+static uint8_t _get_kmst(cmdObj_t *cmd);	// get slave heater state
+static uint8_t _get_kmage(cmdObj_t *cmd);	// get ms since the slave's last response
+static uint8_t _get_kmerr(cmdObj_t *cmd);	// get slave error count
+static uint8_t _set_kmsp(cmdObj_t *cmd);	// broadcast a setpoint to all slaves
+static uint8_t _set_kmsy(cmdObj_t *cmd);	// broadcast a sync to all slaves
+#endif
+
+#ifdef __PROFILER
+static uint8_t _set_prfid(cmdObj_t *cmd);	// select profiler region for readout
+static uint8_t _get_prfct(cmdObj_t *cmd);	// get sample count for selected region
+static uint8_t _get_prfmn(cmdObj_t *cmd);	// get minimum cycles for selected region
+static uint8_t _get_prfav(cmdObj_t *cmd);	// get average cycles for selected region
+static uint8_t _get_prfmx(cmdObj_t *cmd);	// get maximum cycles for selected region
+static uint8_t _set_prfrs(cmdObj_t *cmd);	// reset all profiler regions
+static uint8_t _set_ltid(cmdObj_t *cmd);	// select latency phase for readout
+static uint8_t _get_ltct(cmdObj_t *cmd);	// get command count for selected phase
+static uint8_t _get_lt50(cmdObj_t *cmd);	// get median (us) for selected phase
+static uint8_t _get_lt99(cmdObj_t *cmd);	// get 99th percentile (us) for selected phase
+static uint8_t _get_ltmx(cmdObj_t *cmd);	// get maximum (us) for selected phase
+static uint8_t _set_ltrs(cmdObj_t *cmd);	// reset all latency histograms
+static uint8_t _get_lh(cmdObj_t *cmd);		// get a histogram bucket for selected phase
+#endif
+
 /***********************************************************************************
  **** CONFIG ARRAY  ****************************************************************
  ***********************************************************************************
@@ -170,6 +239,29 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	{ "sys","fb", _f07, _get_dbl, _set_dbl, (double *)&cfg.fw_build,   BUILD_NUMBER }, // MUST BE FIRST!
 	{ "sys","fv", _f07, _get_dbl, _set_dbl, (double *)&cfg.fw_version, VERSION_NUMBER },
 	{ "sys","hv", _f07, _get_dbl, _set_dbl, (double *)&cfg.hw_version, HARDWARE_VERSION },
+	{ "sys","idle", _fns, _get_ui8, _set_nul, (double *)&device.idle_percent, 0 },	// read-only
+	{ "sys","upt",  _fns, _get_upt, _set_nul, (double *)&device.uptime_ms, 0 },		// read-only. Whole seconds
+	{ "sys","upms", _fns, _get_upt, _set_nul, (double *)&device.uptime_ms, 0 },		// read-only. Milliseconds into the second
+	{ "sys","rst",  _fns, _get_ui8, _set_nul, (double *)&device.reset_flags, 0 },	// read-only. MCUSR at the last reset
+	{ "sys","tkov", _fns, _get_int, _set_int, (double *)&device.tick_overruns, 0 },	// set to 0 to reset
+	{ "sys","sync", _fns, _get_nul, _set_sync,(double *)&kc.null, 0 },				// sent by broadcast
+#ifdef __XIO_RS485
+	{ "sys","rsad", _fns, _get_ui8, _set_rsad,(double *)&rsx.addr, RS485_ADDRESS },
+#endif
+#ifndef __KINEN_MASTER
+	{ "sys","drdy", _f07, _get_ui8, _set_drdy,(double *)&spx.drdy, SPI_DRDY },		// 1 = SPI data ready line on PB0
+#endif
+
+	// Event log - "evl" answers with the record count then streams the log (not in any group)
+	{ "", "evld", _fns, _get_ui8, _set_nul, (double *)&evlog.dropped, 0 },		// read-only. Events lost to a full queue
+	{ "", "evl",  _fns, _get_evl, _set_nul, (double *)&kc.null, 0 },
+
+	// Stored queries - define with {"q1":["tok1","tok2",...]}, fetch with {"q1":null} (see _get_qry())
+	{ "", "q1", _fns, _get_qry, _set_qry, (double *)&kc.null, 0 },
+	{ "", "q2", _fns, _get_qry, _set_qry, (double *)&kc.null, 0 },
+
+	// Schema - {"sch":null} streams the table so entries can be addressed as "#N" (see _get_sch())
+	{ "", "sch", _fns, _get_sch, _set_nul, (double *)&kc.null, 0 },
 
 	// Heater object
 	{ "h1", "h1st",  _f00, _get_ui8, _set_ui8,(double *)&heater.state, HEATER_OFF },
@@ -177,7 +269,7 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	{ "h1", "h1set", _f00, _get_dbl, _set_dbl,(double *)&heater.setpoint, HEATER_HYSTERESIS },
 	{ "h1", "h1hys", _f00, _get_ui8, _set_ui8,(double *)&heater.hysteresis, HEATER_HYSTERESIS },
 	{ "h1", "h1amb", _f00, _get_dbl, _set_dbl,(double *)&heater.ambient_temperature, HEATER_AMBIENT_TEMPERATURE },
-	{ "h1", "h1ovr", _f00, _get_dbl, _set_dbl,(double *)&heater.overheat_temperature, HEATER_OVERHEAT_TEMPERATURE },
+	{ "h1", "h1ovr", _f00, _get_dbl, _set_h1ovr,(double *)&heater.overheat_temperature, HEATER_OVERHEAT_TEMPERATURE },
 	{ "h1", "h1ato", _f00, _get_dbl, _set_dbl,(double *)&heater.ambient_timeout, HEATER_AMBIENT_TIMEOUT },
 	{ "h1", "h1reg", _f00, _get_dbl, _set_dbl,(double *)&heater.regulation_range, HEATER_REGULATION_RANGE },
 	{ "h1", "h1rto", _f00, _get_dbl, _set_dbl,(double *)&heater.regulation_timeout, HEATER_REGULATION_TIMEOUT },
@@ -188,6 +280,8 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	{ "s1", "s1tmp", _f00, _get_dbl, _set_dbl,(double *)&sensor.temperature, LESS_THAN_ZERO },
 	{ "s1", "s1svm", _f00, _get_dbl, _set_dbl,(double *)&sensor.sample_variance_max, SENSOR_SAMPLE_VARIANCE_MAX },
 	{ "s1", "s1rvm", _f00, _get_dbl, _set_dbl,(double *)&sensor.reading_variance_max, SENSOR_READING_VARIANCE_MAX },
+	{ "s1", "s1slw", _f00, _get_dbl, _set_dbl,(double *)&sensor.slew_max, SENSOR_SLEW_MAX },
+	{ "s1", "s1cd",  _f00, _get_ui8, _set_nul,(double *)&sensor.code, SENSOR_IDLE },
 
 	// PID object
 //	{ "p1", "p1st",  _f00, _get_ui8, _set_ui8,(double *)&pid.state, 0 },
@@ -196,13 +290,124 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	{ "p1", "p1kd",	 _f00, _get_dbl, _set_dbl,(double *)&pid.Kd, PID_Kd },
 	{ "p1", "p1smx", _f00, _get_dbl, _set_dbl,(double *)&pid.output_max, PID_MAX_OUTPUT },
 	{ "p1", "p1smn", _f00, _get_dbl, _set_dbl,(double *)&pid.output_min, PID_MIN_OUTPUT },
+	{ "p1", "p1out", _f00, _get_dbl, _set_nul,(double *)&pid.output, 0 },		// read-only
+
+	// Alarm rules - select a rule with alid then read or set its fields (see alarm.h)
+	{ "al", "alid",  _f00, _get_ui8, _set_alid,(double *)&al.select, 0 },
+	{ "al", "alix",  _f00, _get_al,  _set_al, (double *)&kc.null, 0 },
+	{ "al", "alop",  _f00, _get_al,  _set_al, (double *)&kc.null, 0 },
+	{ "al", "alth",  _f00, _get_al,  _set_al, (double *)&kc.null, 0 },
+	{ "al", "albw",  _f00, _get_al,  _set_al, (double *)&kc.null, 0 },
+	{ "al", "alhy",  _f00, _get_al,  _set_al, (double *)&kc.null, 0 },
+	{ "al", "alhd",  _f00, _get_al,  _set_al, (double *)&kc.null, 0 },
+	{ "al", "alst",  _f00, _get_al,  _set_nul,(double *)&kc.null, 0 },		// read-only
+
+	// Cooler object (negative side of the split-range controller)
+	{ "c1", "c1db",  _f00, _get_dbl, _set_dbl,(double *)&cooler.deadband, COOLER_DEADBAND },
+	{ "c1", "c1dty", _f00, _get_dbl, _set_nul,(double *)&cooler.duty, 0 },		// read-only
+
+	// Control quality metrics for the current heat cycle (read-only - see heater_metrics())
+	{ "m1", "m1ttr", _f00, _get_dbl, _set_nul,(double *)&metrics.time_to_regulated, 0 },
+	{ "m1", "m1ovs", _f00, _get_dbl, _set_nul,(double *)&metrics.overshoot, 0 },
+	{ "m1", "m1iae", _f00, _get_dbl, _set_nul,(double *)&metrics.iae, 0 },
+	{ "m1", "m1rms", _f00, _get_dbl, _set_nul,(double *)&metrics.rms, 0 },
+	{ "m1", "m1dmn", _f00, _get_dbl, _set_nul,(double *)&metrics.duty_mean, 0 },
+	{ "m1", "m1dvr", _f00, _get_dbl, _set_nul,(double *)&metrics.duty_var, 0 },
+	{ "m1", "m1ext", _f00, _get_ui8, _set_nul,(double *)&metrics.exits, 0 },
+
+	// Runaway detector object
+	{ "r1", "r1gn",  _f00, _get_dbl, _set_dbl,(double *)&runaway.gain, RUNAWAY_GAIN },
+	{ "r1", "r1ls",  _f00, _get_dbl, _set_dbl,(double *)&runaway.loss, RUNAWAY_LOSS },
+	{ "r1", "r1fr",  _f00, _get_dbl, _set_dbl,(double *)&runaway.fraction, RUNAWAY_FRACTION },
+	{ "r1", "r1mn",  _f00, _get_dbl, _set_dbl,(double *)&runaway.rate_min, RUNAWAY_RATE_MIN },
+	{ "r1", "r1hys", _f00, _get_ui8, _set_ui8,(double *)&runaway.hysteresis, RUNAWAY_HYSTERESIS },
+	{ "r1", "r1rt",  _f00, _get_dbl, _set_nul,(double *)&runaway.rate, 0 },		// read-only
+	{ "r1", "r1ex",  _f00, _get_dbl, _set_nul,(double *)&runaway.expected, 0 },	// read-only
+	{ "r1", "r1flt", _f00, _get_ui8, _set_nul,(double *)&runaway.faults, 0 },		// read-only
+
+	// Memory usage - free stack and buffer high-water marks (bytes, read-only)
+	{ "mem","memfs", _f00, _get_memfs,_set_nul,(double *)&kc.null, 0 },
+	{ "mem","memur", _f00, _get_memur,_set_nul,(double *)&kc.null, 0 },
+	{ "mem","memut", _f00, _get_memut,_set_nul,(double *)&kc.null, 0 },
+	{ "mem","memsr", _f00, _get_memsr,_set_nul,(double *)&kc.null, 0 },
+	{ "mem","memst", _f00, _get_memst,_set_nul,(double *)&kc.null, 0 },
+	{ "mem","memcs", _f00, _get_ui8,  _set_nul,(double *)&cmdStr.wp_hwm, 0 },
+	{ "mem","memcb", _f00, _get_ui8,  _set_nul,(double *)&cmd_body_hwm, 0 },
+	{ "mem","memkb", _f00, _get_ui8,  _set_nul,(double *)&kc.buf_hwm, 0 },
+
+	// xio statistics - select a device with xioid (0=USART, 1=SPI) then read its counters
+	// ring high-water marks for the devices are in the mem group
+	{ "xio","xioid", _f00, _get_ui8,  _set_xioid,(double *)&xio_select, XIO_DEV_USART },
+	{ "xio","xiorb", _f00, _get_xiorb,_set_nul,  (double *)&kc.null, 0 },
+	{ "xio","xiotb", _f00, _get_xiotb,_set_nul,  (double *)&kc.null, 0 },
+	{ "xio","xiord", _f00, _get_xiord,_set_nul,  (double *)&kc.null, 0 },
+	{ "xio","xiotd", _f00, _get_xiotd,_set_nul,  (double *)&kc.null, 0 },
+	{ "xio","xioov", _f00, _get_xioov,_set_nul,  (double *)&kc.null, 0 },
+	{ "xio","xioll", _f00, _get_xioll,_set_nul,  (double *)&kc.null, 0 },
+	{ "xio","xioet", _f00, _get_xioet,_set_nul,  (double *)&kc.null, 0 },
+	{ "xio","xiors", _f00, _get_nul,  _set_xiors,(double *)&kc.null, 0 },
+
+#ifdef __KINEN_MASTER
+	// Kinen master aggregate table - select a slave with kmid then read its values
+	{ "km", "kmn",   _f00, _get_ui8,  _set_nul, (double *)&km.slave_count, 0 },
+	{ "km", "kmid",  _f00, _get_ui8,  _set_kmid,(double *)&km.select, 0 },
+	{ "km", "kmsl",  _f00, _get_kmsl, _set_nul, (double *)&kc.null, 0 },
+	{ "km", "kmtmp", _f00, _get_kmtmp,_set_nul, (double *)&kc.null, 0 },
+	{ "km", "kmst",  _f00, _get_kmst, _set_nul, (double *)&kc.null, 0 },
+	{ "km", "kmage", _f00, _get_kmage,_set_nul, (double *)&kc.null, 0 },
+	{ "km", "kmerr", _f00, _get_kmerr,_set_nul, (double *)&kc.null, 0 },
+	{ "km", "kmsp",  _f00, _get_nul,  _set_kmsp,(double *)&kc.null, 0 },
+	{ "km", "kmsy",  _f00, _get_nul,  _set_kmsy,(double *)&kc.null, 0 },
+#endif
+
+#ifdef __PROFILER
+	// Profiler - select a region with prfid then read its stats (in CPU cycles)
+	{ "prf","prfid", _f00, _get_ui8,  _set_prfid,(double *)&prf.select, PRF_SENSOR },
+	{ "prf","prfct", _f00, _get_prfct,_set_nul,  (double *)&kc.null, 0 },
+	{ "prf","prfmn", _f00, _get_prfmn,_set_nul,  (double *)&kc.null, 0 },
+	{ "prf","prfav", _f00, _get_prfav,_set_nul,  (double *)&kc.null, 0 },
+	{ "prf","prfmx", _f00, _get_prfmx,_set_nul,  (double *)&kc.null, 0 },
+	{ "prf","prfrs", _f00, _get_nul,  _set_prfrs,(double *)&kc.null, 0 },
+
+	// Command latency - select a phase with ltid then read its histogram (in microseconds)
+	{ "lt", "ltid",  _f00, _get_ui8,  _set_ltid, (double *)&lat.select, LAT_TOTAL },
+	{ "lt", "ltct",  _f00, _get_ltct, _set_nul,  (double *)&kc.null, 0 },
+	{ "lt", "lt50",  _f00, _get_lt50, _set_nul,  (double *)&kc.null, 0 },
+	{ "lt", "lt99",  _f00, _get_lt99, _set_nul,  (double *)&kc.null, 0 },
+	{ "lt", "ltmx",  _f00, _get_ltmx, _set_nul,  (double *)&kc.null, 0 },
+	{ "lt", "ltrs",  _f00, _get_nul,  _set_ltrs, (double *)&kc.null, 0 },
+	{ "lh", "lh0",   _f00, _get_lh,   _set_nul,  (double *)&kc.null, 0 },
+	{ "lh", "lh1",   _f00, _get_lh,   _set_nul,  (double *)&kc.null, 0 },
+	{ "lh", "lh2",   _f00, _get_lh,   _set_nul,  (double *)&kc.null, 0 },
+	{ "lh", "lh3",   _f00, _get_lh,   _set_nul,  (double *)&kc.null, 0 },
+	{ "lh", "lh4",   _f00, _get_lh,   _set_nul,  (double *)&kc.null, 0 },
+	{ "lh", "lh5",   _f00, _get_lh,   _set_nul,  (double *)&kc.null, 0 },
+	{ "lh", "lh6",   _f00, _get_lh,   _set_nul,  (double *)&kc.null, 0 },
+	{ "lh", "lh7",   _f00, _get_lh,   _set_nul,  (double *)&kc.null, 0 },
+	{ "lh", "lh8",   _f00, _get_lh,   _set_nul,  (double *)&kc.null, 0 },
+	{ "lh", "lh9",   _f00, _get_lh,   _set_nul,  (double *)&kc.null, 0 },
+#endif
 
 	// Group lookups - must follow the single-valued entries for proper sub-string matching
 	// *** Must agree with CMD_COUNT_GROUPS below ****
 	{ "","sys",_f00, _get_grp, _set_grp,(double *)&kc.null,0 },	// system group
-	{ "","h1", _f00, _get_grp, _set_grp,(double *)&kc.null,0 },	// heater group
-	{ "","s1", _f00, _get_grp, _set_grp,(double *)&kc.null,0 },	// sensor group
-	{ "","p1", _f00, _get_grp, _set_grp,(double *)&kc.null,0 }		// PID group
+	{ "","h1", _fca, _get_grp, _set_grp,(double *)&kc.null,0 },	// heater group
+	{ "","s1", _fca, _get_grp, _set_grp,(double *)&kc.null,0 },	// sensor group
+	{ "","mem",_f00, _get_grp, _set_grp,(double *)&kc.null,0 },	// memory usage group
+	{ "","xio",_f00, _get_grp, _set_grp,(double *)&kc.null,0 },	// xio statistics group
+#ifdef __KINEN_MASTER
+	{ "","km", _f00, _get_grp, _set_grp,(double *)&kc.null,0 },	// kinen master group
+#endif
+#ifdef __PROFILER
+	{ "","prf",_f00, _get_grp, _set_grp,(double *)&kc.null,0 },	// profiler group
+	{ "","lt", _f00, _get_grp, _set_grp,(double *)&kc.null,0 },	// command latency group
+	{ "","lh", _f00, _get_grp, _set_grp,(double *)&kc.null,0 },	// latency histogram group
+#endif
+	{ "","c1", _fca, _get_grp, _set_grp,(double *)&kc.null,0 },	// cooler group
+	{ "","al", _fca, _get_grp, _set_grp,(double *)&kc.null,0 },	// alarm rule group
+	{ "","m1", _fca, _get_grp, _set_grp,(double *)&kc.null,0 },	// control quality metrics group
+	{ "","r1", _fca, _get_grp, _set_grp,(double *)&kc.null,0 },	// runaway detector group
+	{ "","p1", _fca, _get_grp, _set_grp,(double *)&kc.null,0 }		// PID group
 //																				   ^  watch the final (missing) comma!
 	// Uber-group (groups of groups, for text-mode displays only)
 	// *** Must agree with CMD_COUNT_UBER_GROUPS below ****
@@ -256,7 +461,17 @@ const cfgItem_t cfgArray[] PROGMEM = {
 
 /***** Make sure these defines line up with any changes in the above table *****/
 
-#define CMD_COUNT_GROUPS 		4		// count of simple groups
+#ifdef __PROFILER
+#define CMD_COUNT_PRF_GROUPS	3		// profiler, latency and latency histogram groups
+#else
+#define CMD_COUNT_PRF_GROUPS	0
+#endif
+#ifdef __KINEN_MASTER
+#define CMD_COUNT_KM_GROUPS		1		// kinen master group
+#else
+#define CMD_COUNT_KM_GROUPS		0
+#endif
+#define CMD_COUNT_GROUPS 		(10 + CMD_COUNT_PRF_GROUPS + CMD_COUNT_KM_GROUPS)	// count of simple groups
 #define CMD_COUNT_UBER_GROUPS 	0 		// count of uber-groups
 
 #define CMD_INDEX_MAX (sizeof cfgArray / sizeof(cfgItem_t))
@@ -275,6 +490,399 @@ uint8_t cmd_index_lt_groups(index_t index) { return ((index <= CMD_INDEX_START_G
 /***********************************************************************************
  **** FUNCTIONS AND PROTOTYPES *****************************************************
  ***********************************************************************************/
+
+/*
+ *	A float only holds the millisecond uptime exactly for 4.6 hours, so it's read 
+ *	as whole seconds (upt) and milliseconds into the second (upms). Both are exact 
+ *	until the millisecond counter wraps at 49.7 days. upms right after upt in the same request, as in the sys group, uses 
+ *	upt's reading so the pair can't straddle a second.
+ */
+static uint32_t upt_ms;						// the last uptime read by upt
+
+static uint8_t _get_upt(cmdObj_t *cmd)
+{
+	if (pgm_read_byte(&cfgArray[cmd->index].token[2]) == 't') {
+		upt_ms = sys_get_uptime_ms();
+		cmd->value = (double)(upt_ms / 1000);
+	} else {
+		if ((cmd->pv == NULL) || (cmd->pv->index != cmd->index - 1)) { upt_ms = sys_get_uptime_ms();}
+		cmd->value = (double)(upt_ms % 1000);
+	}
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _set_sync(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value >= 1000)) { return (SC_INPUT_VALUE_RANGE_ERROR);}
+	return (sys_sync((uint16_t)cmd->value));
+}
+
+#ifdef __XIO_RS485
+static uint8_t _set_rsad(cmdObj_t *cmd)
+{
+	if ((cmd->value < 1) || (cmd->value > RS485_ADDRESS_MAX)) { return (SC_INPUT_VALUE_RANGE_ERROR);}
+	return (_set_ui8(cmd));
+}
+#endif
+
+#ifndef __KINEN_MASTER
+static uint8_t _set_drdy(cmdObj_t *cmd)
+{
+	xio_set_drdy_spi((cmd->value == 0) ? false : true);
+	return (SC_OK);
+}
+#endif
+
+static uint8_t _set_h1ovr(cmdObj_t *cmd)
+{
+	heater_set_overheat(cmd->value);
+	return (SC_OK);
+}
+
+static uint8_t _get_evl(cmdObj_t *cmd)
+{
+	cmd->value = (double)evlog_print();
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+/*
+ * Alarm rules
+ *
+ *	_get_al() and _set_al() serve all the fields of the rule selected by alid. 
+ *	The field is picked by the 4th character of the token.
+ */
+static uint8_t _set_alid(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value >= AL_RULES)) { return (SC_INPUT_VALUE_RANGE_ERROR);}
+	return (_set_ui8(cmd));
+}
+
+static uint8_t _get_al(cmdObj_t *cmd)
+{
+	alRule_t *r = &al.rule[al.select];
+	cmd->type = TYPE_INTEGER;
+	switch (pgm_read_byte(&cfgArray[cmd->index].token[3])) {
+		case 'x': { cmd->value = r->index; break;}
+		case 'p': { cmd->value = r->op; break;}
+		case 't': { cmd->value = r->fired; break;}
+		case 'h': { cmd->value = r->threshold; cmd->type = TYPE_FLOAT; break;}
+		case 'w': { cmd->value = r->band; cmd->type = TYPE_FLOAT; break;}
+		case 'y': { cmd->value = r->hysteresis; cmd->type = TYPE_FLOAT; break;}
+		case 'd': { cmd->value = r->hold; cmd->type = TYPE_FLOAT; break;}
+	}
+	return (SC_OK);
+}
+
+static uint8_t _set_al(cmdObj_t *cmd)
+{
+	alRule_t *r = &al.rule[al.select];
+	switch (pgm_read_byte(&cfgArray[cmd->index].token[3])) {
+		case 'x': {						// only plain values - getters like evl and q1 act as well as read
+			if ((cmd->value < 0) || (cmd->value >= CMD_INDEX_MAX)) { return (SC_INPUT_VALUE_RANGE_ERROR);}
+			fptrCmd get = (fptrCmd)pgm_read_word(&cfgArray[(index_t)cmd->value].get);
+			if ((get != _get_dbl) && (get != _get_ui8) && (get != _get_int)) {
+				return (SC_INPUT_VALUE_UNSUPPORTED);
+			}
+			r->index = (index_t)cmd->value;
+			break;
+		}
+		case 'p': {
+			if ((cmd->value < 0) || (cmd->value > AL_OUTSIDE)) { return (SC_INPUT_VALUE_RANGE_ERROR);}
+			r->op = (uint8_t)cmd->value;
+			break;
+		}
+		case 'h': { r->threshold = cmd->value; return (SC_OK);}
+		case 'w': {
+			if (cmd->value < 0) { return (SC_INPUT_VALUE_RANGE_ERROR);}
+			r->band = cmd->value;
+			return (SC_OK);
+		}
+		case 'y': { r->hysteresis = cmd->value; return (SC_OK);}
+		case 'd': { r->hold = cmd->value; return (SC_OK);}
+	}
+	r->fired = false;					// a new index or op re-arms the rule
+	r->timer = 0;
+	return (SC_OK);
+}
+
+/*
+ * Memory usage readouts
+ */
+static uint8_t _get_memfs(cmdObj_t *cmd)
+{
+	cmd->value = (double)sys_get_free_stack();
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_memur(cmdObj_t *cmd)
+{
+	cmd->value = (double)ds[XIO_DEV_USART]->rx->hwm;
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_memut(cmdObj_t *cmd)
+{
+	cmd->value = (double)ds[XIO_DEV_USART]->tx->hwm;
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_memsr(cmdObj_t *cmd)
+{
+	cmd->value = (double)ds[XIO_DEV_SPI]->rx->hwm;
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_memst(cmdObj_t *cmd)
+{
+	cmd->value = (double)ds[XIO_DEV_SPI]->tx->hwm;
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+/*
+ * xio statistics readouts - these operate on the device selected by xioid
+ */
+static uint8_t _set_xioid(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value >= XIO_DEV_COUNT) || (ds[(uint8_t)cmd->value] == NULL)) {
+		return (SC_INPUT_VALUE_RANGE_ERROR);
+	}
+	return (_set_ui8(cmd));
+}
+
+static uint8_t _get_xio_counter(cmdObj_t *cmd, uint32_t value)
+{
+	cmd->value = (double)value;
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_xiorb(cmdObj_t *cmd)
+{
+	xioStats_t s;
+	xio_get_stats(xio_select, &s);
+	return (_get_xio_counter(cmd, s.rx_bytes));
+}
+
+static uint8_t _get_xiotb(cmdObj_t *cmd)
+{
+	xioStats_t s;
+	xio_get_stats(xio_select, &s);
+	return (_get_xio_counter(cmd, s.tx_bytes));
+}
+
+static uint8_t _get_xiord(cmdObj_t *cmd)
+{
+	xioStats_t s;
+	xio_get_stats(xio_select, &s);
+	return (_get_xio_counter(cmd, s.rx_drops));
+}
+
+static uint8_t _get_xiotd(cmdObj_t *cmd)
+{
+	xioStats_t s;
+	xio_get_stats(xio_select, &s);
+	return (_get_xio_counter(cmd, s.tx_drops));
+}
+
+static uint8_t _get_xioov(cmdObj_t *cmd)
+{
+	xioStats_t s;
+	xio_get_stats(xio_select, &s);
+	return (_get_xio_counter(cmd, s.rx_overruns));
+}
+
+static uint8_t _get_xioll(cmdObj_t *cmd)
+{
+	xioStats_t s;
+	xio_get_stats(xio_select, &s);
+	return (_get_xio_counter(cmd, s.line_too_long));
+}
+
+static uint8_t _get_xioet(cmdObj_t *cmd)
+{
+	xioStats_t s;
+	xio_get_stats(xio_select, &s);
+	return (_get_xio_counter(cmd, s.etx_count));
+}
+
+static uint8_t _set_xiors(cmdObj_t *cmd)
+{
+	xio_reset_stats(xio_select);
+	return (SC_OK);
+}
+
+#ifdef __KINEN_MASTER
+/*
+ * Kinen master readouts - these operate on the slave selected by kmid
+ */
+static uint8_t _set_kmid(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value >= KINEN_SLAVE_MAX)) { return (SC_INPUT_VALUE_RANGE_ERROR);}
+	return (_set_ui8(cmd));
+}
+
+static uint8_t _get_kmsl(cmdObj_t *cmd)
+{
+	cmd->value = (double)km.slave[km.select].state;
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_kmtmp(cmdObj_t *cmd)
+{
+	cmd->value = km.slave[km.select].value[KM_TEMPERATURE];
+	cmd->type = TYPE_FLOAT;
+	return (SC_OK);
+}
+
+static uint8_t _get_kmst(cmdObj_t *cmd)
+{
+	cmd->value = km.slave[km.select].value[KM_STATE];
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_kmage(cmdObj_t *cmd)
+{
+	cmd->value = (double)(sys_get_uptime_ms() - km.slave[km.select].response_ms);
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_kmerr(cmdObj_t *cmd)
+{
+	cmd->value = (double)km.slave[km.select].errors;
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _set_kmsp(cmdObj_t *cmd) { return (kinen_broadcast("h1set", cmd->value));}
+static uint8_t _set_kmsy(cmdObj_t *cmd) { return (kinen_sync());}
+#endif // __KINEN_MASTER
+
+#ifdef __PROFILER
+/*
+ * Profiler readouts - these operate on the region selected by prfid
+ */
+static uint8_t _set_prfid(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value >= PRF_REGION_COUNT)) { return (SC_INPUT_VALUE_RANGE_ERROR);}
+	return (_set_ui8(cmd));
+}
+
+static uint8_t _get_prfct(cmdObj_t *cmd)
+{
+	prfStats_t s;
+	prf_get_stats(prf.select, &s);
+	cmd->value = (double)s.count;
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_prfmn(cmdObj_t *cmd)
+{
+	prfStats_t s;
+	prf_get_stats(prf.select, &s);
+	cmd->value = (s.count == 0) ? 0 : (double)s.min;
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_prfav(cmdObj_t *cmd)
+{
+	prfStats_t s;
+	prf_get_stats(prf.select, &s);
+	cmd->value = (s.count == 0) ? 0 : (double)s.sum / s.count;
+	cmd->type = TYPE_FLOAT;
+	return (SC_OK);
+}
+
+static uint8_t _get_prfmx(cmdObj_t *cmd)
+{
+	prfStats_t s;
+	prf_get_stats(prf.select, &s);
+	cmd->value = (double)s.max;
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _set_prfrs(cmdObj_t *cmd)
+{
+	prf_reset();
+	return (SC_OK);
+}
+
+/*
+ * Command latency readouts - these operate on the phase selected by ltid
+ *
+ *	_get_lh() serves all the buckets. The bucket number is the third character 
+ *	of the cfgArray token ("lh0" - "lh9").
+ */
+static uint8_t _set_ltid(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value >= LAT_PHASE_COUNT)) { return (SC_INPUT_VALUE_RANGE_ERROR);}
+	return (_set_ui8(cmd));
+}
+
+static uint8_t _get_ltct(cmdObj_t *cmd)
+{
+	latHist_t h;
+	lat_get_stats(lat.select, &h);
+	cmd->value = (double)lat_get_count(&h);
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_lt50(cmdObj_t *cmd)
+{
+	latHist_t h;
+	lat_get_stats(lat.select, &h);
+	cmd->value = (double)lat_get_percentile(&h, 50);
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_lt99(cmdObj_t *cmd)
+{
+	latHist_t h;
+	lat_get_stats(lat.select, &h);
+	cmd->value = (double)lat_get_percentile(&h, 99);
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _get_ltmx(cmdObj_t *cmd)
+{
+	latHist_t h;
+	lat_get_stats(lat.select, &h);
+	cmd->value = (double)h.max;
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+
+static uint8_t _set_ltrs(cmdObj_t *cmd)
+{
+	lat_reset();
+	return (SC_OK);
+}
+
+static uint8_t _get_lh(cmdObj_t *cmd)
+{
+	latHist_t h;
+	lat_get_stats(lat.select, &h);
+	cmd->value = (double)h.bucket[pgm_read_byte(&cfgArray[cmd->index].token[2]) - '0'];
+	cmd->type = TYPE_INTEGER;
+	return (SC_OK);
+}
+#endif // __PROFILER
+
 /*
 static uint8_t _get_htmp(cmdObj_t *cmd)
 {
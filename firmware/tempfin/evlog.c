@@ -0,0 +1,193 @@
+/*
+ * evlog.c - persistent event log in an EEPROM ring
+ * Part of Kinen project
+ *
+ * Copyright (c) 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>				// for ultoa
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#include "kinen.h"
+#include "system.h"
+#include "heater.h"
+#include "evlog.h"
+#include "print.h"
+#include "xio/xio.h"
+
+static uint8_t _evlog_check(const evRecord_t *rec);
+static uint8_t *_evlog_address(uint8_t slot);
+
+/*
+ * evlog_init() - find where the log left off
+ *
+ *	The newest record is the valid one with the highest sequence number. The
+ *	sequence numbers wrap, so they are compared by their signed difference.
+ */
+void evlog_init()
+{
+	evRecord_t rec;
+	uint8_t found = false;
+
+	evlog.seq = 0;
+	evlog.slot = 0;
+	evlog.byte = 0;
+	evlog.head = 0;
+	evlog.tail = 0;
+	evlog.count = 0;
+	evlog.dropped = 0;
+	evlog.print_left = 0;
+
+	for (uint8_t slot=0; slot<EVLOG_RECORDS; slot++) {
+		eeprom_read_block(&rec, _evlog_address(slot), sizeof(evRecord_t));
+		if (rec.check != _evlog_check(&rec)) { continue;}
+		if ((found == false) || ((int16_t)(rec.seq - evlog.seq) >= 0)) {
+			evlog.seq = rec.seq + 1;
+			evlog.slot = slot + 1;
+			found = true;
+		}
+	}
+	if (evlog.slot >= EVLOG_RECORDS) { evlog.slot = 0;}
+}
+
+/*
+ * evlog_event() - queue an event for writing
+ *
+ *	The heater values are taken now. If the queue is full the event is counted
+ *	in evlog.dropped and lost.
+ */
+void evlog_event(uint8_t event, uint8_t code)
+{
+	if (evlog.count >= EVLOG_QUEUE) {
+		if (evlog.dropped < 0xFF) { evlog.dropped++;}
+		return;
+	}
+	evRecord_t *rec = &evlog.queue[evlog.head];
+	rec->seq = evlog.seq++;
+	rec->ms = sys_get_uptime_ms();
+	rec->event = event;
+	rec->code = code;
+	rec->temperature = (int16_t)(heater.temperature * 10);
+	rec->setpoint = (int16_t)(heater.setpoint * 10);
+	rec->output = (int8_t)pid.output;
+	rec->check = _evlog_check(rec);
+	if (++evlog.head >= EVLOG_QUEUE) { evlog.head = 0;}
+	evlog.count++;
+}
+
+/*
+ * evlog_callback() - write the next byte of the queue to EEPROM
+ *
+ *	Runs from the bottom of the main loop. Returns SC_NOOP if there is nothing
+ *	to write or the EEPROM is still busy with the last byte, so it never waits.
+ */
+uint8_t evlog_callback()
+{
+	if ((evlog.count == 0) || (eeprom_is_ready() == false)) { return (SC_NOOP);}
+
+	uint8_t *rec = (uint8_t *)&evlog.queue[evlog.tail];
+	eeprom_write_byte(_evlog_address(evlog.slot) + evlog.byte, rec[evlog.byte]);
+	if (++evlog.byte < sizeof(evRecord_t)) { return (SC_OK);}
+
+	evlog.byte = 0;
+	if (++evlog.slot >= EVLOG_RECORDS) { evlog.slot = 0;}
+	if (++evlog.tail >= EVLOG_QUEUE) { evlog.tail = 0;}
+	evlog.count--;
+	return (SC_OK);
+}
+
+/*
+ * evlog_print() 		  - start printing the log and return the number of records
+ * evlog_print_callback() - print the next record when the response stream is idle
+ *
+ *	Lines are {"ev":[seq,ms,event,code,temperature,setpoint,output]}. A line is
+ *	longer than the TX lanes, so one is only started when the stream has nothing 
+ *	queued. It goes in the priority lane, which drains it while it's written. The 
+ *	callback doesn't wait for the EEPROM either - it tries again on the next pass
+ *	if evlog_callback() is part way through a byte.
+ *
+ *	The count is the valid records when the print starts, and only those are 
+ *	printed - events logged during the print are left for the next one. Fewer 
+ *	lines come out if new events overwrite old records before they're printed.
+ */
+uint8_t evlog_print()
+{
+	evRecord_t rec;
+	uint8_t count = 0;
+
+	eeprom_busy_wait();						// one byte write at most (evlog_callback())
+	for (uint8_t slot=0; slot<EVLOG_RECORDS; slot++) {
+		if ((slot == evlog.slot) && (evlog.byte != 0)) { continue;}
+		eeprom_read_block(&rec, _evlog_address(slot), sizeof(evRecord_t));
+		if (rec.check == _evlog_check(&rec)) { count++;}
+	}
+	evlog.print_slot = evlog.slot;			// oldest first
+	evlog.print_left = EVLOG_RECORDS;
+	evlog.print_seq = evlog.seq - evlog.count;	// first record not yet in EEPROM
+	return (count);
+}
+
+uint8_t evlog_print_callback()
+{
+	evRecord_t rec;
+	char buf[PRINT_FLOAT_LEN];
+	FILE *stream = EVLOG_STREAM;
+
+	if (evlog.print_left == 0) { return (SC_NOOP);}
+	if (xio_tx_queued(xio_get_dev(stream)) != 0) { return (SC_NOOP);}
+	if (eeprom_is_ready() == false) { return (SC_NOOP);}
+
+	eeprom_read_block(&rec, _evlog_address(evlog.print_slot), sizeof(evRecord_t));
+	if (++evlog.print_slot >= EVLOG_RECORDS) { evlog.print_slot = 0;}
+	evlog.print_left--;
+	if (rec.check != _evlog_check(&rec)) { return (SC_OK);}
+	if ((int16_t)(rec.seq - evlog.print_seq) >= 0) { return (SC_OK);}	// logged since the print started
+
+	xio_set_priority(stream, true);
+	print_str_P(stream, PSTR("{\"ev\":["));
+	print_ftoa(buf, rec.seq, 0);			print_str(stream, buf);
+	print_str_P(stream, PSTR(","));
+	ultoa(rec.ms, buf, 10);					print_str(stream, buf);	// exact - a float rounds past 2^24 ms
+	print_str_P(stream, PSTR(","));
+	print_ftoa(buf, rec.event, 0);			print_str(stream, buf);
+	print_str_P(stream, PSTR(","));
+	print_ftoa(buf, rec.code, 0);			print_str(stream, buf);
+	print_str_P(stream, PSTR(","));
+	print_ftoa(buf, rec.temperature / 10.0, 1);	print_str(stream, buf);
+	print_str_P(stream, PSTR(","));
+	print_ftoa(buf, rec.setpoint / 10.0, 1);print_str(stream, buf);
+	print_str_P(stream, PSTR(","));
+	print_ftoa(buf, rec.output, 0);			print_str(stream, buf);
+	print_str_P(stream, PSTR("]}\n"));
+	xio_set_priority(stream, false);
+	return (SC_OK);
+}
+
+static uint8_t _evlog_check(const evRecord_t *rec)
+{
+	const uint8_t *p = (const uint8_t *)rec;
+	uint8_t crc = EVLOG_CRC_SEED;			// so a zeroed slot doesn't check
+
+	for (uint8_t i=0; i<offsetof(evRecord_t, check); i++) {
+		crc = _crc_ibutton_update(crc, *p++);
+	}
+	return (crc);
+}
+
+static uint8_t *_evlog_address(uint8_t slot)
+{
+	return ((uint8_t *)(EVLOG_BASE + (uint16_t)slot * sizeof(evRecord_t)));
+}
@@ -0,0 +1,97 @@
+/*
+ * evlog.h - persistent event log in an EEPROM ring
+ * Part of Kinen project
+ *
+ * Copyright (c) 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* --- How it works ---
+ *
+ *	Events are fixed size records in a ring of EVLOG_RECORDS slots in EEPROM.
+ *	Each record carries a sequence number, the uptime, the event and its code,
+ *	and the heater temperature, setpoint and PID output at the time. Every new
+ *	record goes in the next slot, so the writes are spread evenly over the ring.
+ *
+ *	evlog_event() fills a record in a small RAM queue and returns. EEPROM writes
+ *	take about 3.4 ms a byte, so evlog_callback() writes one byte per pass from
+ *	the bottom of the main loop, and only when the EEPROM is ready. The check byte
+ *	goes last, so a record that was cut off by a reset reads as empty.
+ *
+ *	At startup evlog_init() scans the ring for the highest valid sequence number
+ *	to find where to carry on. The "evl" command answers with the record count,
+ *	then evlog_print_callback() streams the log on the same stream, oldest first,
+ *	one {"ev":[...]} line per record and one record per main loop pass. A record
+ *	is only started when the response stream has nothing queued, so nothing is 
+ *	dropped however slowly the host reads.
+ */
+#ifndef evlog_h
+#define evlog_h
+
+/******************************************************************************
+ * PARAMETERS AND SETTINGS
+ ******************************************************************************/
+
+#define EVLOG_RECORDS		32			// slots in the ring
+#define EVLOG_BASE			((E2END + 1) - (EVLOG_RECORDS * sizeof(evRecord_t)))	// ring is at the top of EEPROM
+										// 1024 - 32 * 14 = 576. Config NVM (index * NVM_VALUE_LEN) is below 
+										// it, which leaves room for 144 cfgArray entries
+#define EVLOG_QUEUE			3			// records waiting to be written
+#define EVLOG_CRC_SEED		0x5A		// check byte seed - neither an erased nor a zeroed slot checks
+#define EVLOG_STREAM		stderr		// the log is read out on the response stream
+
+enum evEvent {							// events
+	EV_NONE = 0,
+	EV_BOOT,							// device reset. Code is MCUSR (see device.reset_flags)
+	EV_HEATER_ON,						// heater turned on
+	EV_HEATER_OFF,						// heater turned off. Code is heater.code
+	EV_HEATER_SHUTDOWN					// heater shut down on a fault. Code is heater.code
+};
+
+/******************************************************************************
+ * STRUCTURES
+ ******************************************************************************/
+
+typedef struct EvRecord {		// one record - as stored in EEPROM
+	uint16_t seq;				// sequence number (wraps)
+	uint32_t ms;				// uptime (ms)
+	uint8_t event;				// see enum evEvent
+	uint8_t code;				// event detail
+	int16_t temperature;		// heater temperature (tenths of a degree)
+	int16_t setpoint;			// heater setpoint (tenths of a degree)
+	int8_t output;				// PID output (percent, negative is cooling)
+	uint8_t check;				// CRC-8 of everything above. Written last
+} evRecord_t;
+
+typedef struct EvLog {
+	uint16_t seq;				// sequence number of the next event
+	uint8_t slot;				// ring slot the next record is written to
+	uint8_t byte;				// bytes of the head of the queue written so far
+	uint8_t head;				// next free queue entry
+	uint8_t tail;				// queue entry being written
+	uint8_t count;				// entries in the queue
+	uint8_t dropped;			// events lost to a full queue
+	uint8_t print_slot;			// next ring slot to print
+	uint8_t print_left;			// ring slots left to print (0 if not printing)
+	uint16_t print_seq;			// only records older than this are printed
+	evRecord_t queue[EVLOG_QUEUE];
+} evLog_t;
+evLog_t evlog;					// event log is a singleton
+
+/******************************************************************************
+ * FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+void evlog_init(void);
+void evlog_event(uint8_t event, uint8_t code);
+uint8_t evlog_callback(void);
+uint8_t evlog_print(void);
+uint8_t evlog_print_callback(void);
+
+#endif
@@ -19,22 +19,32 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <string.h>
 #include <math.h>
 #include <avr/pgmspace.h>
+#include <util/crc16.h>
 
 #include "kinen.h"
 #include "system.h"
 #include "heater.h"
 #include "sensor.h"
 #include "report.h"
+#include "print.h"
+#include "evlog.h"
+
+static warm_t warm __attribute__ ((section (".noinit")));
+static void _warm_save(void);
+static uint16_t _warm_crc(void);
 
 /**** Heater Functions ****/
 /*
  * heater_init() - initialize heater with default values
  * heater_on()	 - turn heater on
  * heater_off()	 - turn heater off	
+ * heater_set_overheat() - set the overheat temperature and the hardware cutoff above it
+ * heater_restore() - pick up where the heater left off after a watchdog or brown-out reset
  * heater_callback() - 100ms timed loop for heater control
  *
  *	heater_init() sets default values that may be overwritten via Kinen communications. 
@@ -51,8 +61,12 @@ void heater_init()
 	heater.ambient_temperature = HEATER_AMBIENT_TEMPERATURE;
 	heater.overheat_temperature = HEATER_OVERHEAT_TEMPERATURE;
 	heater.bad_reading_max = HEATER_BAD_READING_MAX;
+	heater_set_overheat(HEATER_OVERHEAT_TEMPERATURE);
 	sensor_init();
 	pid_init();
+	runaway_init();
+	cooler.deadband = COOLER_DEADBAND;
+	cooler.duty = 0;
 }
 
 void heater_on(double setpoint)
@@ -61,10 +75,17 @@ void heater_on(double setpoint)
 	if ((heater.state == HEATER_HEATING) || (heater.state == HEATER_REGULATED)) {
 		return;
 	}
+	// refuse if the hardware cutoff says it's already too hot
+	if (ac_arm() == false) {
+		heater_off(HEATER_SHUTDOWN, HEATER_HARDWARE_CUTOFF);
+		return;
+	}
 	// turn on lower level functions
 	sensor_on();						// enable the sensor
 	sensor_start_reading();				// now start a reading
 	pid_reset();
+	runaway_reset();
+	metrics.time = 0;					// start a new metrics cycle on the first pass
 	pwm_on(PWM_FREQUENCY, 0);			// duty cycle will be set by PID loop
 
 	// initialize values for a heater cycle
@@ -72,25 +93,130 @@ void heater_on(double setpoint)
 	heater.hysteresis = 0;
 	heater.bad_reading_count = 0;
 	heater.regulation_timer = 0;		// reset timeouts
+	heater.last_ms = sys_get_uptime_ms();
 	heater.state = HEATER_HEATING;
 	led_off();
+	_warm_save();
+	evlog_event(EV_HEATER_ON, HEATER_OK);
 }
 
 void heater_off(uint8_t state, uint8_t code) 
 {
 	pwm_off();							// stop sending current to the heater
+	heater_split(0);					// ...and stop cooling it
 	sensor_off();						// stop taking readings
 	heater.state = state;
 	heater.code = code;
 	led_off();
+	_warm_save();
+	evlog_event((state == HEATER_SHUTDOWN) ? EV_HEATER_SHUTDOWN : EV_HEATER_OFF, code);
+}
+
+void heater_set_overheat(double temperature)
+{
+	heater.overheat_temperature = temperature;
+	ac_set_threshold(temperature);
+}
+
+/*
+ * heater_restore() - pick up where the heater left off after a watchdog or brown-out reset
+ * _warm_save()		- copy the heater state to the .noinit block
+ * _warm_crc()		- CRC of the .noinit block
+ *
+ *	Every reset runs heater_init() and leaves the heater off, so a glitch in the 
+ *	middle of a process costs a full reheat. The state needed to carry on - state, 
+ *	setpoint and PID integral - is kept in a .noinit block that the C startup code 
+ *	doesn't clear. It's saved by heater_on(), heater_off() and every heater pass. 
+ *
+ *	After a watchdog or brown-out reset heater_restore() checks the CRC and turns 
+ *	the heater back on where it was. It's called from every 100 ms callout just 
+ *	ahead of heater_callback() but only acts on the first, so the first pass runs 
+ *	straight away and the comparator's threshold RC has had 100 ms to settle - 
+ *	called from main() ac_arm() would refuse and shut the heater down. Other 
+ *	resets (power-on, the reset pin) start cold. It stops restoring after 
+ *	WARM_RESTARTS_MAX restarts in a row so a fault that kills the loop can't keep 
+ *	the heater cycling. Returns true if it restored.
+ */
+static uint8_t warm_checked;			// heater_restore() only acts once per reset
+
+uint8_t heater_restore()
+{
+	if (warm_checked == true) { return (false);}
+	warm_checked = true;
+	if (((device.reset_flags & RESET_WARM_bm) == 0) || (warm.crc != _warm_crc())) {
+		warm.restarts = 0;
+		_warm_save();
+		return (false);
+	}
+	if ((warm.state != HEATER_HEATING) && (warm.state != HEATER_REGULATED)) {
+		return (false);
+	}
+	if (++warm.restarts > WARM_RESTARTS_MAX) {
+		heater_off(HEATER_SHUTDOWN, HEATER_OK);
+		print_msg_P(stdout, PSTR("Heater Warm Restart Limit\n"));
+		return (false);
+	}
+	uint8_t state = warm.state;
+	double integral = warm.integral;
+	heater_on(warm.setpoint);
+	if (heater.state != HEATER_HEATING) { return (false);}	// heater_on() refused
+	pid.integral = integral;
+	if (state == HEATER_REGULATED) {
+		heater.state = HEATER_REGULATED;
+		heater.hysteresis = HEATER_HYSTERESIS;
+	}
+	_warm_save();
+	print_str_P(stdout, PSTR("Heater Warm Restart\n"));
+	return (true);
+}
+
+static uint16_t _warm_crc()
+{
+	uint16_t crc = 0xFFFF;
+	uint8_t *p = (uint8_t *)&warm;
+
+	for (uint8_t i=0; i<offsetof(warm_t, crc); i++) {
+		crc = _crc_ccitt_update(crc, *p++);
+	}
+	return (crc);
+}
+
+static void _warm_save()
+{
+	if (sys_get_uptime_ms() > WARM_STABLE_MS) { warm.restarts = 0;}
+	warm.state = heater.state;
+	warm.setpoint = heater.setpoint;
+	warm.integral = pid.integral;
+	warm.crc = _warm_crc();
 }
 
 void heater_callback()
 {
 	// catch the no-op cases
 	if ((heater.state == HEATER_OFF) || (heater.state == HEATER_SHUTDOWN)) { return;}
+	_warm_save();						// keep the last pass for heater_restore()
 	rpt_readout();
 
+	// measure the real time since the last pass - may be more than a tick under load
+	uint32_t now = sys_get_uptime_ms();
+	pid.dt = (now - heater.last_ms) / 1000.0;
+	if (pid.dt < PID_DT_MIN) { pid.dt = PID_DT;}
+	heater.last_ms = now;
+
+	// the comparator has already cut the PWM output - make it stick
+	if (device.ac_tripped == true) {
+		heater_off(HEATER_SHUTDOWN, HEATER_HARDWARE_CUTOFF);
+		print_msg_P(stdout, PSTR("Heater Hardware Cutoff Shutdown\n"));
+		return;
+	}
+
+	// a latched sensor fault has already cut the PWM output - make it stick
+	if (sensor_get_state() == SENSOR_FAULT) {
+		heater_off(HEATER_SHUTDOWN, HEATER_SENSOR_ERROR);
+		print_msg_P(stdout, PSTR("Heater Sensor Fault Shutdown\n"));
+		return;
+	}
+
 	// get current temperature from the sensor
 	heater.temperature = sensor_get_temperature();
 
@@ -106,33 +232,42 @@ void heater_callback()
 	if (heater.temperature < ABSOLUTE_ZERO) {
 		if (++heater.bad_reading_count > heater.bad_reading_max) {
 			heater_off(HEATER_SHUTDOWN, HEATER_SENSOR_ERROR);
-			printf_P(PSTR("Heater Sensor Error Shutdown\n"));	
+			print_msg_P(stdout, PSTR("Heater Sensor Error Shutdown\n"));	
 		}
 		return;
 	}
 	heater.bad_reading_count = 0;		// reset the bad reading counter
 
-	double duty_cycle = pid_calculate(heater.setpoint, heater.temperature);
+	double duty_cycle = heater_split(pid_calculate(heater.setpoint, heater.temperature));
 	pwm_set_duty(duty_cycle);
 
+	// catch a heater that isn't heating the way its duty cycle says it should
+	if (runaway_check(heater.temperature, duty_cycle, pid.dt) == true) {
+		heater_off(HEATER_SHUTDOWN, HEATER_RUNAWAY);
+		print_msg_P(stdout, PSTR("Heater Runaway Shutdown\n"));
+		return;
+	}
+
 	// handle HEATER exceptions
 	if (heater.state == HEATER_HEATING) {
-		heater.regulation_timer += HEATER_TICK_SECONDS;
+		heater.regulation_timer += pid.dt;
 
 		if ((heater.temperature < heater.ambient_temperature) &&
 			(heater.regulation_timer > heater.ambient_timeout)) {
 			heater_off(HEATER_SHUTDOWN, HEATER_AMBIENT_TIMED_OUT);
-			printf_P(PSTR("Heater Ambient Error Shutdown\n"));	
+			print_msg_P(stdout, PSTR("Heater Ambient Error Shutdown\n"));	
 			return;
 		}
 		if ((heater.temperature < heater.setpoint) &&
 			(heater.regulation_timer > heater.regulation_timeout)) {
 			heater_off(HEATER_SHUTDOWN, HEATER_REGULATION_TIMED_OUT);
-			printf_P(PSTR("Heater Timeout Error Shutdown\n"));	
+			print_msg_P(stdout, PSTR("Heater Timeout Error Shutdown\n"));	
 			return;
 		}
 	}
 
+	heater_metrics(pid.output);
+
 	// Manage regulation state and LED indicator
 	// Heater.regulation_count is a hysteresis register that increments if the 
 	// heater is at temp, decrements if not. It pegs at max and min values.
@@ -160,6 +295,78 @@ void heater_callback()
 	}
 }
 
+/*
+ * heater_split() - split-range output. Runs the cooler and returns the heater duty cycle
+ *
+ *	Positive PID output is the heater duty cycle, as it always was. Negative output 
+ *	drives the cooling channel (pwm2) once it goes past the deadband, ramping up 
+ *	from zero at the deadband. The deadband keeps the fan from chattering on and 
+ *	off around the setpoint while the heater holds it. Set p1smn to 0 to disable 
+ *	cooling altogether.
+ */
+double heater_split(double output)
+{
+	if (output < -cooler.deadband) {
+		cooler.duty = -output - cooler.deadband;
+	} else {
+		cooler.duty = 0;
+	}
+	pwm2_set_duty(cooler.duty);
+	return ((output > 0) ? output : 0);
+}
+
+/*
+ * heater_metrics() - accumulate control quality metrics for the heat cycle
+ *
+ *	A cycle starts when heater_on() runs or the setpoint changes, so each recipe 
+ *	step gets its own numbers. Each pass adds its dt to the integrals, which keeps 
+ *	them right when passes run late. Everything is readable in the "m1" group:
+ *
+ *	  - time to regulated: from the start of the cycle to the first REGULATED
+ *	  - overshoot: furthest the temperature went past the setpoint after reaching 
+ *		it, in the direction it was travelling
+ *	  - IAE: integral of |error| over the whole cycle
+ *	  - RMS error: only counts time spent REGULATED
+ *	  - duty mean and variance: of the PID output, so cooling counts as negative
+ *	  - exits: times the hysteresis register dropped out of REGULATED
+ *
+ *	Runs before the regulation state is updated for this pass, so an exit is 
+ *	counted on the pass after the hysteresis register drops out.
+ */
+void heater_metrics(double output)
+{
+	double dt = pid.dt;
+	double error = heater.temperature - heater.setpoint;
+
+	if ((metrics.setpoint != heater.setpoint) || (metrics.time == 0)) {
+		memset(&metrics, 0, sizeof(metrics_t));
+		metrics.setpoint = heater.setpoint;
+		metrics.direction = (error < 0) ? 1 : -1;
+		metrics.time_to_regulated = -1;
+		metrics.last_state = HEATER_HEATING;
+	}
+	metrics.time += dt;
+	metrics.iae += fabs(error) * dt;
+	metrics.duty_sum += output * dt;
+	metrics.duty_sq_sum += output * output * dt;
+	metrics.duty_mean = metrics.duty_sum / metrics.time;
+	metrics.duty_var = metrics.duty_sq_sum / metrics.time - metrics.duty_mean * metrics.duty_mean;
+
+	if ((error * metrics.direction) >= 0) { metrics.crossed = true;}
+	if ((metrics.crossed == true) && ((error * metrics.direction) > metrics.overshoot)) {
+		metrics.overshoot = error * metrics.direction;
+	}
+	if (heater.state == HEATER_REGULATED) {
+		if (metrics.time_to_regulated < 0) { metrics.time_to_regulated = metrics.time;}
+		metrics.regulated_time += dt;
+		metrics.sq_error += error * error * dt;
+		metrics.rms = sqrt(metrics.sq_error / metrics.regulated_time);
+	} else if ((metrics.last_state == HEATER_REGULATED) && (metrics.exits < 0xFF)) {
+		metrics.exits++;
+	}
+	metrics.last_state = heater.state;
+}
+
 /**** Heater PID Functions ****/
 /*
  * pid_init() - initialize PID with default values
@@ -174,6 +381,7 @@ void pid_init()
 	pid.Kd = PID_Kd;
 	pid.output_max = PID_MAX_OUTPUT;		// saturation filter max value
 	pid.output_min = PID_MIN_OUTPUT;		// saturation filter min value
+	pid.dt = PID_DT;
 	pid.state = PID_ON;
 }
 
@@ -192,10 +400,10 @@ double pid_calculate(double setpoint,double temperature)
 
 	// perform integration only if error is GT epsilon, and with anti-windup
 	if ((fabs(pid.error) > PID_EPSILON) && (pid.output < pid.output_max)) {	
-		pid.integral += (pid.error * PID_DT);
+		pid.integral += (pid.error * pid.dt);
 	}
 	// compute derivative and output
-	pid.derivative = (pid.error - pid.prev_error) / PID_DT;
+	pid.derivative = (pid.error - pid.prev_error) / pid.dt;
 	pid.output = pid.Kp * pid.error + pid.Ki * pid.integral + pid.Kd * pid.derivative;
 
 	// fix min amd max outputs (saturation filter)
@@ -206,3 +414,92 @@ double pid_calculate(double setpoint,double temperature)
 	return pid.output;
 }
 
+/**** Runaway Detector Functions ****/
+/*
+ * runaway_init()  - set default values
+ * runaway_reset() - empty the window for a new heater cycle
+ * runaway_check() - add a heater pass to the window. Returns true to shut down
+ *
+ *	The ambient and regulation timeouts catch a heater that isn't heating, but 
+ *	only after 90 or 300 seconds. This catches it in a few seconds by comparing 
+ *	the measured heating rate to the rate the duty cycle should be producing.
+ *
+ *	Heater passes are folded into samples of RUNAWAY_SAMPLE_SECONDS. The window 
+ *	holds the last RUNAWAY_WINDOW samples. Each new sample gives a measured rate 
+ *	over the window and an expected rate from a first order model:
+ *
+ *		expected = gain * (mean duty / 100) - loss * (mean temperature - room)
+ *
+ *	A window fails if the measured rate is below fraction * expected and passes 
+ *	otherwise. Failures count the hysteresis register up, passes count it down. 
+ *	It shuts down when the register reaches hysteresis, so one noisy window 
+ *	won't trip it.
+ *
+ *	Windows aren't judged until the window is full, which covers the sensor lag 
+ *	at turn-on. Nor are they judged when the expected rate is below rate_min or 
+ *	the heater is within regulation range of the setpoint. Near the setpoint the 
+ *	duty cycle is mostly balancing losses, and the model is too rough for that.
+ */
+void runaway_init()
+{
+	memset(&runaway, 0, sizeof(runaway_t));
+	runaway.gain = RUNAWAY_GAIN;
+	runaway.loss = RUNAWAY_LOSS;
+	runaway.fraction = RUNAWAY_FRACTION;
+	runaway.rate_min = RUNAWAY_RATE_MIN;
+	runaway.hysteresis = RUNAWAY_HYSTERESIS;
+}
+
+void runaway_reset()
+{
+	runaway.count = 0;
+	runaway.index = 0;
+	runaway.faults = 0;
+	runaway.rate = 0;
+	runaway.expected = 0;
+	runaway.sample_time = 0;
+	runaway.sample_heat = 0;
+}
+
+uint8_t runaway_check(double temperature, double duty, double dt)
+{
+	runaway.sample_time += dt;
+	runaway.sample_heat += duty * dt;
+	if (runaway.sample_time < RUNAWAY_SAMPLE_SECONDS) { return (false);}
+
+	// the oldest sample is the start of the window. It's overwritten by the new one
+	uint8_t i = runaway.index;
+	double start = runaway.temperature[i];
+	runaway.temperature[i] = temperature;
+	runaway.heat[i] = runaway.sample_heat;
+	runaway.time[i] = runaway.sample_time;
+	runaway.sample_time = 0;
+	runaway.sample_heat = 0;
+	if (++runaway.index >= RUNAWAY_WINDOW) { runaway.index = 0;}
+	if (runaway.count < RUNAWAY_WINDOW) {
+		runaway.count++;
+		return (false);
+	}
+
+	// the window is the samples after the start - i.e. all of them now
+	double heat = 0;
+	double time = 0;
+	for (i=0; i<RUNAWAY_WINDOW; i++) {
+		heat += runaway.heat[i];
+		time += runaway.time[i];
+	}
+	runaway.rate = (temperature - start) / time;
+	runaway.expected = runaway.gain * (heat / time) / 100 - 
+					   runaway.loss * ((temperature + start) / 2 - RUNAWAY_ROOM_TEMPERATURE);
+
+	if ((runaway.expected < runaway.rate_min) ||
+		(temperature > heater.setpoint - heater.regulation_range)) {
+		return (false);
+	}
+	if (runaway.rate < runaway.expected * runaway.fraction) {
+		if (++runaway.faults >= runaway.hysteresis) { return (true);}
+	} else {
+		if (runaway.faults > 0) { runaway.faults--;}
+	}
+	return (false);
+}
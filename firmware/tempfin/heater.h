@@ -32,6 +32,18 @@
 #define HEATER_REGULATION_TIMEOUT 	300		// time to allow heater to come to temp (seconds)
 #define HEATER_BAD_READING_MAX 		5		// maximum successive bad readings before shutting down
 
+#define WARM_RESTARTS_MAX			3		// give up restoring after this many warm restarts in a row
+#define WARM_STABLE_MS				60000	// restarts are no longer "in a row" after this much uptime
+
+#define RUNAWAY_WINDOW				4		// number of samples in the sliding window (one per RUNAWAY_SAMPLE_SECONDS)
+#define RUNAWAY_SAMPLE_SECONDS		1.0		// seconds per window sample
+#define RUNAWAY_ROOM_TEMPERATURE	25		// temperature the loss term is measured from
+#define RUNAWAY_GAIN				2.0		// expected heating rate at 100% duty from room temperature (degrees/second)
+#define RUNAWAY_LOSS				0.005	// expected loss rate per degree above room temperature (1/second)
+#define RUNAWAY_FRACTION			0.25	// fault if the measured rate is below this fraction of the expected rate
+#define RUNAWAY_RATE_MIN			0.5		// don't judge windows that expect less than this (degrees/second)
+#define RUNAWAY_HYSTERESIS			3		// failing windows (net of passing ones) before shutting down
+
 enum tcHeaterState {						// heater state machine
 	HEATER_OFF = 0,							// heater turned OFF or never turned on - transitions to HEATING
 	HEATER_SHUTDOWN,						// heater has been shut down - transitions to HEATING
@@ -44,15 +56,20 @@ enum tcHeaterCode {
 	HEATER_AMBIENT_TIMED_OUT,				// heater failed to get past ambient temperature
 	HEATER_REGULATION_TIMED_OUT,			// heater heated but failed to achieve regulation before timeout
 	HEATER_OVERHEATED,						// heater exceeded maximum temperature cutoff value
-	HEATER_SENSOR_ERROR						// heater encountered a fatal sensor error
+	HEATER_SENSOR_ERROR,					// heater encountered a fatal sensor error
+	HEATER_HARDWARE_CUTOFF,					// analog comparator cut the heater (see ac_init())
+	HEATER_RUNAWAY							// heater is not heating at the rate its duty cycle should give
 };
 
 /**** PID default parameters ***/
 
-#define PID_DT 				HEATER_TICK_SECONDS	// time constant for PID computation
+#define PID_DT 				HEATER_TICK_SECONDS	// nominal time constant for PID computation
+#define PID_DT_MIN			0.01			// shortest dt accepted from the uptime clock
 #define PID_EPSILON 		0.1				// error term precision
 #define PID_MAX_OUTPUT 		100				// saturation filter max PWM percent
-#define PID_MIN_OUTPUT 		0				// saturation filter min PWM percent
+#define PID_MIN_OUTPUT 		-100			// saturation filter min PWM percent (negative drives cooling, 0 disables it)
+
+#define COOLER_DEADBAND		5				// PID output must go this far below zero to start cooling (percent)
 
 #define PID_Kp 				5.00			// proportional gain term
 #define PID_Ki 				0.1 			// integral gain term
@@ -88,6 +105,7 @@ typedef struct HeaterStruct {
 	double setpoint;			// set point for regulation
 	double regulation_range;	// +/- range to consider heater in regulation
 	double regulation_timer;	// time taken so far in a HEATING cycle
+	uint32_t last_ms;			// uptime at the previous heater pass
 	double ambient_timeout;		// timeout beyond which regulation has failed (seconds)
 	double regulation_timeout;	// timeout beyond which regulation has failed (seconds)
 	double ambient_temperature;	// temperature below which it's ambient temperature (heater failed)
@@ -104,15 +122,68 @@ typedef struct PIDstruct {		// PID controller itself
 	double prev_error;			// error term from previous pass
 	double integral;			// integral term
 	double derivative;			// derivative term
-//	double dt;					// pid time constant
+	double dt;					// time since the previous PID pass (seconds)
 	double Kp;					// proportional gain
 	double Ki;					// integral gain 
 	double Kd;					// derivative gain
 } PID_t;
 
+typedef struct WarmStruct {		// heater state kept in .noinit RAM across a reset - see heater_restore()
+	uint8_t state;				// heater state
+	uint8_t restarts;			// warm restarts in a row
+	double setpoint;			// set point for regulation
+	double integral;			// PID integral term
+	uint16_t crc;				// CRC-CCITT of everything above
+} warm_t;
+
+typedef struct MetricsStruct {	// control quality for the current heat cycle - see heater_metrics()
+	uint8_t last_state;			// heater state at the previous pass
+	uint8_t crossed;			// temperature has reached the setpoint in this cycle
+	int8_t direction;			// 1 if the cycle started below the setpoint, -1 if above
+	uint8_t exits;				// times regulation was lost (saturates at 255)
+	double setpoint;			// setpoint the cycle is for
+	double time;				// seconds since the cycle started
+	double time_to_regulated;	// seconds from the start to the first REGULATED (-1 until then)
+	double overshoot;			// largest excursion past the setpoint after reaching it (degrees)
+	double iae;					// integral of absolute error over the cycle (degree-seconds)
+	double regulated_time;		// seconds spent REGULATED
+	double sq_error;			// integral of error squared while REGULATED
+	double rms;					// RMS error while REGULATED (degrees)
+	double duty_sum;			// integral of PID output
+	double duty_sq_sum;			// integral of PID output squared
+	double duty_mean;			// mean PID output over the cycle (percent, negative is cooling)
+	double duty_var;			// variance of the PID output over the cycle
+} metrics_t;
+
+typedef struct CoolerStruct {	// cooling side of the split-range controller
+	double deadband;			// negative PID output that must be exceeded to start cooling
+	double duty;				// current cooling duty cycle (percent)
+} cooler_t;
+
+typedef struct RunawayStruct {	// runaway detector - see runaway_check()
+	uint8_t count;				// samples in the window so far (up to RUNAWAY_WINDOW)
+	uint8_t index;				// next slot to write in the window
+	uint8_t faults;				// hysteresis register: failing windows net of passing ones
+	uint8_t hysteresis;			// faults needed to shut down
+	double gain;				// expected heating rate at 100% duty (degrees/second)
+	double loss;				// expected loss rate per degree above room temperature (1/second)
+	double fraction;			// measured/expected ratio below which a window fails
+	double rate_min;			// expected rate below which a window isn't judged
+	double rate;				// measured rate over the last window (degrees/second)
+	double expected;			// expected rate over the last window (degrees/second)
+	double sample_time;			// time accumulated towards the next sample (seconds)
+	double sample_heat;			// duty * time accumulated towards the next sample
+	double temperature[RUNAWAY_WINDOW];	// temperature at the end of each sample
+	double heat[RUNAWAY_WINDOW];// duty * time over each sample (percent-seconds)
+	double time[RUNAWAY_WINDOW];// length of each sample (seconds)
+} runaway_t;
+
 // allocations
 heater_t heater;				// allocate one heater...
 PID_t pid;						// allocate one PID channel...
+runaway_t runaway;				// ...and its runaway detector
+cooler_t cooler;				// ...and its cooling output
+metrics_t metrics;				// ...and its control quality metrics
 
 /******************************************************************************
  * FUNCTION PROTOTYPES
@@ -121,12 +192,20 @@ PID_t pid;						// allocate one PID channel...
 void heater_init(void);
 void heater_on(double setpoint);
 void heater_off(uint8_t state, uint8_t code);
+void heater_set_overheat(double temperature);
+uint8_t heater_restore(void);
 void heater_callback(void);
+double heater_split(double output);
+void heater_metrics(double output);
 
 void pid_init();
 void pid_reset();
 double pid_calculate(double setpoint,double temperature);
 
+void runaway_init(void);
+void runaway_reset(void);
+uint8_t runaway_check(double temperature, double duty, double dt);
+
 /******************************************************************************
  * DEFINE UNIT TESTS
  ******************************************************************************/
@@ -44,6 +44,9 @@
 #include "json_parser.h"
 //#include "report.h"
 #include "util.h"
+#include "print.h"
+#include "profiler.h"
+#include "system.h"					// for device.epoch
 #include "xio/xio.h"				// for char definitions
 
 // local scope stuff
@@ -69,9 +72,17 @@ static uint8_t _normalize_json_string(char *str, uint16_t size);
  *	  {"parent_name":""}
  *	  {"parent_name":{"name":"value"}}
  *	  {"parent_name":{"name1":"value1", "n2":"v2", ... "nN":"vN"}}
+ *	  {"name":["value1", "v2", ... "vN"]}
  *
  *	  "value" can be a string, number, true, false, or null (2 types)
  *
+ *	  "name" can also be "#N" to address cfgArray[N] without a token search
+ *
+ *	Arrays
+ *	  - the elements are kept as CSV ASCII in the string field with the quotes 
+ *		taken out, and the value is the element count. ["a","b",1] becomes a,b,1
+ *	  - arrays can't be nested or hold objects
+ *
  *	Numbers
  *	  - number values are not quoted and can start with a digit or -. 
  *	  - numbers cannot start with + or . (period)
@@ -83,6 +94,7 @@ static uint8_t _normalize_json_string(char *str, uint16_t size);
  *	  - once the array is built it executes the object(s) in order in the array
  *	  - passes the executed array to the response handler to generate the response string
  *	  - returns the status and the JSON response string
+ *	  - a line starting with SYN is a Kinen broadcast. It's executed but gets no response
  *
  *	Separation of concerns
  *	  js_json_parser() is the only exposed part. It does parsing, display, and status reports.
@@ -93,9 +105,29 @@ static uint8_t _normalize_json_string(char *str, uint16_t size);
 
 void js_json_parser(char *str)
 {
+	uint8_t json_flags = JSON_RESPONSE_FORMAT;
+	if (*str == SYN) {				// broadcast line from a Kinen master - execute it silently
+		str++;
+		json_flags = JSON_NO_PRINT;
+	}
 	cmd_reset_list();				// get a fresh cmdObj list
+#ifdef __JSON_CACHE
+	js_cache.hit = false;
+	js_cache.pending = NO_MATCH;
+#endif
 	uint8_t status = _json_parser_kernal(str);
-	cmd_print_list(status, TEXT_NO_PRINT, JSON_RESPONSE_FORMAT);
+	lat_exec();						// command latency stamp (profiler.h)
+#ifdef __JSON_CACHE
+	if (js_cache.hit == true) {		// the response is already serialized
+		if ((json_flags != JSON_NO_PRINT) && (kc.comm_mode == JSON_MODE)) {
+			xio_set_priority(stderr, true);
+			print_str(stderr, js_cache.buf);
+			xio_set_priority(stderr, false);
+		}
+		return;
+	}
+#endif
+	cmd_print_list(status, TEXT_NO_PRINT, json_flags);
 //	rpt_request_status_report();	// generate an incremental status report if there are gcode model changes
 }
 
@@ -119,8 +151,13 @@ uint8_t _json_parser_kernal(char *str)
 		if (group[0] != NUL) {
 			strncpy(cmd->group, group, CMD_GROUP_LEN);// copy the parent's group to this child
 		}
-		// validate the token and get the index
-		if ((cmd->index = cmd_get_index(cmd->group, cmd->token)) == NO_MATCH) { 
+		// validate the token and get the index ("#N" is the index itself)
+		if (cmd->token[0] == '#') {
+			cmd->index = cmd_get_index_direct(cmd->token);
+		} else {
+			cmd->index = cmd_get_index(cmd->group, cmd->token);
+		}
+		if (cmd->index == NO_MATCH) { 
 			return (SC_UNRECOGNIZED_COMMAND);
 		}
 		if ((cmd_index_is_group(cmd->index)) && (cmd_group_is_prefixed(cmd->token))) {
@@ -132,6 +169,15 @@ uint8_t _json_parser_kernal(char *str)
 	// execute the command
 	cmd = cmd_body;
 	if (cmd->type == TYPE_NULL){				// means GET the value
+#ifdef __JSON_CACHE
+		if (cmd_index_is_cacheable(cmd->index)) {
+			if ((js_cache.index == cmd->index) && (js_cache.epoch == device.epoch)) {
+				js_cache.hit = true;			// js_json_parser() sends the cached response
+				return (SC_OK);
+			}
+			js_cache.pending = cmd->index;		// cache the response once it's serialized
+		}
+#endif
 		ritorno(cmd_get(cmd));					// ritorno returns w/status on any errors
 	} else {
 		ritorno(cmd_set(cmd));					// set value or call a function (e.g. gcode)
@@ -245,8 +291,19 @@ static uint8_t _get_nv_pair_strict(cmdObj_t *cmd, char **pstr, int8_t *depth)
 	// arrays
 	} else if (**pstr == '[') {
 		cmd->type = TYPE_ARRAY;
-		ritorno(cmd_copy_string(cmd, *pstr));		// copy array into string for error displays
-		return (SC_INPUT_VALUE_UNSUPPORTED);		// return error as the parser doesn't do input arrays yet
+		(*pstr)++;
+		if ((tmp = strchr(*pstr, ']')) == NULL) { return (SC_JSON_SYNTAX_ERROR);} // find the end of the array
+		*tmp = NUL;
+		char *wr = *pstr;
+		cmd->value = (**pstr == NUL) ? 0 : 1;
+		for (char *rd = *pstr; *rd != NUL; rd++) {	// squeeze out the quotes and count the elements
+			if (*rd == '\"') { continue;}
+			if (*rd == ',') { cmd->value++;}
+			*wr++ = *rd;
+		}
+		*wr = NUL;
+		ritorno(cmd_copy_string(cmd, *pstr));
+		*pstr = ++tmp;
 
 	// general error condition
 	} else { return (SC_JSON_SYNTAX_ERROR); }			// ill-formed JSON
@@ -301,15 +358,26 @@ uint16_t js_serialize_json(cmdObj_t *cmd, char *out_buf)
 		if (cmd->type != TYPE_EMPTY) {
 			if (need_a_comma) { *str++ = ',';}
 			need_a_comma = true;
-			str += sprintf(str, "\"%s\":", cmd->token);
-			if (cmd->type == TYPE_NULL)	{ str += sprintf(str, "\"\"");}
-			else if (cmd->type == TYPE_INTEGER)	{ str += sprintf(str, "%1.0f", cmd->value);}
-			else if (cmd->type == TYPE_FLOAT)	{ str += sprintf(str, "%0.3f", cmd->value);}
-			else if (cmd->type == TYPE_STRING)	{ str += sprintf(str, "\"%s\"",*cmd->stringp);}
-			else if (cmd->type == TYPE_ARRAY)	{ str += sprintf(str, "[%s]",  *cmd->stringp);}
+			*str++ = '"';
+			str = print_strcpy(str, cmd->token);
+			*str++ = '"';
+			*str++ = ':';
+			if (cmd->type == TYPE_NULL)	{ str = print_strcpy(str, "\"\"");}
+			else if (cmd->type == TYPE_INTEGER)	{ str = print_ftoa(str, cmd->value, 0);}
+			else if (cmd->type == TYPE_FLOAT)	{ str = print_ftoa(str, cmd->value, 3);}
+			else if (cmd->type == TYPE_STRING)	{ 
+				*str++ = '"';
+				str = print_strcpy(str, *cmd->stringp);
+				*str++ = '"';
+			}
+			else if (cmd->type == TYPE_ARRAY)	{ 
+				*str++ = '[';
+				str = print_strcpy(str, *cmd->stringp);
+				*str++ = ']';
+			}
 			else if (cmd->type == TYPE_BOOL) 	{
-				if (cmd->value == false) { str += sprintf(str, "false");}
-				else { str += sprintf(str, "true"); }
+				if (cmd->value == false) { str = print_strcpy(str, "false");}
+				else { str = print_strcpy(str, "true"); }
 			}
 			if (cmd->type == TYPE_PARENT) { 
 				*str++ = '{';
@@ -325,7 +393,7 @@ uint16_t js_serialize_json(cmdObj_t *cmd, char *out_buf)
 	}
 	// closing curlies and NEWLINE
 	while (prev_depth-- > initial_depth) { *str++ = '}';}
-	str += sprintf(str, "}\n");	// using sprintf for this last one ensures a NUL termination
+	str = print_strcpy(str, "}\n");	// print_strcpy() NUL terminates
 	return (str - out_buf);
 }
 
@@ -335,11 +403,16 @@ uint16_t js_serialize_json(cmdObj_t *cmd, char *out_buf)
  *	Ignores JSON verbosity settings and everything else - just serializes the list & prints
  *	Useful for reports and other simple output.
  *	Object list should be terminated by cmd->nx == NULL
+ *	Returns the length of the string left in kc.buf, including the NUL
  */
-void js_print_json_object(cmdObj_t *cmd)
+uint16_t js_print_json_object(cmdObj_t *cmd)
 {
-	js_serialize_json(cmd, kc.buf);
-	fprintf(stderr, "%s", kc.buf);
+	uint16_t len = js_serialize_json(cmd, kc.buf) + 1;
+	if (len > kc.buf_hwm) { kc.buf_hwm = len;}
+	xio_set_priority(stderr, true);		// responses go ahead of queued reports
+	print_str(stderr, kc.buf);
+	xio_set_priority(stderr, false);
+	return (len);
 }
 
 /*
@@ -364,8 +437,26 @@ void js_print_json_object(cmdObj_t *cmd)
 
 void js_print_json_response(uint8_t status)
 {
-	js_print_json_object(cmd_list);
+	uint16_t len = js_print_json_object(cmd_list);
+#ifdef __JSON_CACHE
+	if ((status == SC_OK) && (js_cache.pending != NO_MATCH) && (len <= JSON_CACHE_LEN)) {
+		memcpy(js_cache.buf, kc.buf, len);
+		js_cache.index = js_cache.pending;
+		js_cache.epoch = device.epoch;
+	}
+	js_cache.pending = NO_MATCH;
+#endif
+}
+
+#ifdef __JSON_CACHE
+/*
+ * js_cache_invalidate() - drop the cached group response (see json_parser.h)
+ */
+void js_cache_invalidate()
+{
+	js_cache.index = NO_MATCH;
 }
+#endif
 /*
 	if (cm.machine_state == MACHINE_INITIALIZING) {		// always do full echo during startup
 		fprintf(stderr,"\n");
@@ -38,13 +38,48 @@
 #define JSON_OUTPUT_STRING_MAX (TEXT_BUFFER_LEN)
 #define JSON_MAX_DEPTH 4
 
+/* Group response cache
+ *
+ *	A master, an HMI and a logger may all read {"h1":""} inside the same 100ms 
+ *	heater tick and get the same answer each time. The cache keeps the last 
+ *	serialized response to a group GET and sends it again if the same group is 
+ *	read before anything could have changed it. A hit skips _get_grp() and the 
+ *	serializer and just copies the string into the TX buffer.
+ *
+ *	Only groups flagged F_CACHE in cfgArray are cached - the ones whose values 
+ *	only move in the tick callbacks (h1, s1, p1, c1, m1, r1, al). Groups with live 
+ *	counters (sys, mem, xio, the profiler) are always rebuilt. The response is 
+ *	dropped when device.epoch moves (each 100ms tick and each sensor reading) and 
+ *	on any cmd_set(). The epoch is 32 bits so it can't come back round to the 
+ *	value of an old response - that would take years.
+ *
+ *	There is one slot. It's the size of the response buffer, which is 135 bytes 
+ *	of RAM in all. A response that doesn't fit isn't cached. Comment out 
+ *	__JSON_CACHE to get the RAM back.
+ */
+#define __JSON_CACHE
+#define JSON_CACHE_LEN (JSON_OUTPUT_STRING_MAX)
+
+#ifdef __JSON_CACHE
+typedef struct jsCache {
+	index_t index;				// group the response is for (NO_MATCH if empty)
+	index_t pending;			// group GET being run - cached when its response prints
+	uint8_t hit;				// the parser is answering from the cache
+	uint32_t epoch;				// device.epoch when the response was made
+	char buf[JSON_CACHE_LEN];	// the response, NUL terminated
+} jsCache_t;
+jsCache_t js_cache;				// one response cache
+
+void js_cache_invalidate(void);
+#endif
+
 /*
  * Global Scope Functions
  */
 
 void js_json_parser(char *str);
 uint16_t js_serialize_json(cmdObj_t *cmd, char *out_buf);
-void js_print_json_object(cmdObj_t *cmd);
+uint16_t js_print_json_object(cmdObj_t *cmd);
 void js_print_json_response(uint8_t status);
 
 /* unit test setup */
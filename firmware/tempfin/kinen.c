@@ -15,16 +15,292 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
 
 #include "kinen.h"
+#include "system.h"
+#include "util.h"
+#include "print.h"
+#include <util/delay.h>					// must follow F_CPU in system.h
+#include "xio/xio.h"
+
+#ifdef __KINEN_MASTER
+static void _enumerate(void);
+static char _transfer(const char c);
+static void _parse_response(kinenSlave_t *s);
+static void _receive(kinenSlave_t *s, char c);
+static void _broadcast(void);
+
+// Poll requests, in the order of the aggregate table columns (kinenPollValue)
+static const char kinen_poll_0[] PROGMEM = "{\"h1tmp\":\"\"}\n";
+static const char kinen_poll_1[] PROGMEM = "{\"h1st\":\"\"}\n";
+static PGM_P const kinen_poll[] PROGMEM = { kinen_poll_0, kinen_poll_1 };
+#endif
 
 /*
  * kinen_init() - set up Kinen subsystems; master or slave
  *
- *	Would like some kind of auto-detect here. For now it's just commenting
+ *	Master or slave is selected at compile time with __KINEN_MASTER in kinen.h. 
+ *	A slave needs nothing here - the SPI slave device is set up by xio_init().
+ *	A master sets up the SPI hardware as bus master and enumerates the slaves.
+ *	Runs before interrupts are enabled, so enumeration uses busy-wait delays.
  */
 void kinen_init(void)
 {
+#ifdef __KINEN_MASTER
+	memset(&km, 0, sizeof(kinenMaster_t));
+	PRR &= ~PRSPI_bm;						// Enable SPI in power reduction register (system.h)
+	KINEN_CS_PORT |= KINEN_CS_MASK;			// deselect all slaves before driving the lines
+	KINEN_CS_DDR |= KINEN_CS_MASK;
+	DDRB |= KINEN_SPI_OUTBITS;
+	PORTB |= (1<<PORTB4);					// pull-up on MISO so an empty socket reads 0xFF
+	KINEN_DRDY_PORT |= KINEN_DRDY_bm;		// pull-up on data ready (an input)
+	SPCR = KINEN_SPI_MODE;
+	_enumerate();
+#endif
 	return;
 }
+
+#ifdef __KINEN_MASTER
+/*
+ * _transfer() - exchange one byte with the selected slave
+ *
+ *	The delay after each byte gives the slave's SPI ISR time to stage its next
+ *	output character. Without it the slave would return stale data.
+ */
+static char _transfer(const char c)
+{
+	SPDR = c;
+	while ((SPSR & (1<<SPIF)) == 0);
+	_delay_us(KINEN_BYTE_DELAY_US);
+	return (SPDR);
+}
+
+/*
+ * _enumerate() - find the slaves on the chip select lines
+ *
+ *	Each socket is probed with STXs. A live slave answers ETX when it has nothing
+ *	to send, or text if it does. An empty socket returns NULs or 0xFFs (see the
+ *	protocol notes in xio_spi.c). The first byte is ignored because it's whatever 
+ *	the slave had in its data register before the probe.
+ */
+static void _enumerate()
+{
+	char c;
+
+	for (uint8_t i=0; i<KINEN_SLAVE_MAX; i++) {
+		KINEN_CS_PORT &= ~KINEN_CS_bm(i);
+		_transfer(STX);
+		for (uint8_t j=1; j<KINEN_ENUM_BYTES; j++) {
+			c = _transfer(STX);
+			if ((c == ETX) || (c == LF) || ((c >= ' ') && (c < DEL))) {
+				km.slave[i].state = KM_IDLE;
+			}
+		}
+		KINEN_CS_PORT |= KINEN_CS_bm(i);
+		if (km.slave[i].state != KM_ABSENT) { km.slave_count++;}
+	}
+}
+
+/*
+ * kinen_busy() - return true if any slave has a request in flight
+ *
+ *	The main loop must not sleep while this is true as the master's SPI 
+ *	transfers are driven from the loop, not from interrupts.
+ */
+uint8_t kinen_busy()
+{
+	for (uint8_t i=0; i<KINEN_SLAVE_MAX; i++) {
+		if (km.slave[i].state >= KM_SENDING) { return (true);}
+	}
+	if (km.bcast[0] != NUL) { return (true);}
+	return (false);
+}
+
+/*
+ * kinen_callback() - service the next slave in round-robin order
+ *
+ *	Each pass services one slave with at most KINEN_BYTES_PER_PASS transfers. 
+ *	While one slave is working on a request the others are being sent theirs, 
+ *	so the requests to all slaves are pipelined. Every transfer returns a byte 
+ *	from the slave; anything other than ETX, NUL or 0xFF is response text.
+ *
+ *	A queued broadcast goes out as soon as no request is part way sent to any 
+ *	slave, so the broadcast line can't land in the middle of another line. No new 
+ *	requests are started while a broadcast is waiting.
+ *
+ *	Returns SC_NOOP if there was nothing to do so the loop can go idle.
+ */
+uint8_t kinen_callback()
+{
+	kinenSlave_t *s = NULL;
+	uint8_t slot = km.next;
+
+	if (km.slave_count == 0) { return (SC_NOOP);}
+	if (km.bcast[0] != NUL) {
+		for (slot=0; slot<KINEN_SLAVE_MAX; slot++) {
+			if (km.slave[slot].state == KM_SENDING) { break;}
+		}
+		if (slot == KINEN_SLAVE_MAX) {
+			_broadcast();
+			return (SC_OK);
+		}
+	}
+	for (uint8_t i=0; i<KINEN_SLAVE_MAX; i++) {		// find the next present slave
+		slot = (km.next + i) % KINEN_SLAVE_MAX;
+		if (km.slave[slot].state != KM_ABSENT) { break;}
+	}
+	km.next = (slot + 1) % KINEN_SLAVE_MAX;
+	s = &km.slave[slot];
+
+	uint32_t now = sys_get_uptime_ms();
+	if (s->state == KM_IDLE) {
+		if ((now - s->request_ms) < KINEN_POLL_MS) { return (SC_NOOP);}	// not due yet
+		if (km.bcast[0] != NUL) { return (SC_NOOP);}	// let the broadcast go first
+		if (++s->request >= KINEN_POLL_COUNT) { s->request = 0;}
+		s->tx = (const char *)pgm_read_word(&kinen_poll[s->request]);
+		s->request_ms = now;
+		s->len = 0;
+		s->state = KM_SENDING;
+	} else if ((s->state == KM_WAITING) && ((now - s->request_ms) > KINEN_TIMEOUT_MS)) {
+		s->errors++;
+		s->state = KM_IDLE;
+		return (SC_OK);
+	}
+#ifdef __KINEN_DRDY
+	if ((s->state == KM_WAITING) && (KINEN_DRDY_PIN & KINEN_DRDY_bm)) { return (SC_NOOP);}	// no fin has a message
+#endif
+
+	KINEN_CS_PORT &= ~KINEN_CS_bm(slot);
+	for (uint8_t i=0; i<KINEN_BYTES_PER_PASS; i++) {
+		char c_out = STX;							// poll if there's nothing to send
+		if (s->state == KM_SENDING) {
+			c_out = pgm_read_byte(s->tx++);
+			if (c_out == LF) { s->state = KM_WAITING;}
+		}
+		char c = _transfer(c_out);
+		if ((c == ETX) && (s->state == KM_WAITING)) { break;}	// response not ready - let the others run
+		_receive(s, c);
+	}
+	KINEN_CS_PORT |= KINEN_CS_bm(slot);
+	return (SC_OK);
+}
+
+/*
+ * _receive() - collect a byte returned by a slave into its response line
+ *
+ *	Anything other than ETX, NUL or 0xFF is response text. 
+ */
+static void _receive(kinenSlave_t *s, char c)
+{
+	if ((c == NUL) || (c == ETX) || (c == (char)0xFF)) { return;}
+	if (c == LF) {
+		s->line[s->len] = NUL;
+		if (s->state == KM_WAITING) {			// a line while still sending is stale
+			_parse_response(s);
+			s->state = KM_IDLE;
+		}
+		s->len = 0;
+		return;
+	}
+	if (s->len < KINEN_LINE_LEN-1) { s->line[s->len++] = c;}
+}
+
+/*
+ * kinen_broadcast() - queue a broadcast that sets one value on all slaves
+ * kinen_sync()		 - queue a broadcast that syncs all slaves to the master's tick phase
+ *
+ *	Only one broadcast can be queued at a time. It's sent by kinen_callback().
+ *	The sync carries the master's position in the current second. Each slave 
+ *	takes that as its sync clock at the broadcast LF and realigns to it (see 
+ *	sys_sync()). The master realigns itself to the same value, as the sync may 
+ *	have waited in the queue for a few milliseconds.
+ */
+uint8_t kinen_broadcast(const char *token, double value)
+{
+	if (km.slave_count == 0) { return (SC_NO_SUCH_DEVICE);}
+	if (km.bcast[0] != NUL) { return (SC_BUFFER_FULL);}
+	if (fabs(value) > KINEN_BROADCAST_MAX) { return (SC_INPUT_VALUE_TOO_LARGE);}
+
+	char *p = km.bcast;
+	*p++ = '{';
+	*p++ = '"';
+	strcpy(p, token);
+	p += strlen(p);
+	*p++ = '"';
+	*p++ = ':';
+	p = print_ftoa(p, value, 3);
+	*p++ = '}';
+	*p++ = LF;
+	*p = NUL;
+	return (SC_OK);
+}
+
+uint8_t kinen_sync()
+{
+	uint16_t phase = (uint16_t)(sys_get_uptime_ms() % 1000);
+	ritorno(kinen_broadcast("sync", phase));
+	km.bcast_phase = phase;
+	km.bcast_sync = true;
+	return (SC_OK);
+}
+
+/*
+ * _broadcast() - send the queued broadcast line to all slaves at once
+ *
+ *	Each slave is first sent a SYN on its own chip select. The SYN tells the slave
+ *	to release MISO and take the next line as a broadcast (see xio_spi.c). The byte
+ *	returned for the SYN is the slave's next output char so it's collected as usual.
+ *	Then all chip selects are asserted together and the line is sent once, so bus 
+ *	time doesn't grow with the number of fins. The slaves don't respond to it.
+ */
+static void _broadcast()
+{
+	for (uint8_t i=0; i<KINEN_SLAVE_MAX; i++) {
+		if (km.slave[i].state == KM_ABSENT) { continue;}
+		KINEN_CS_PORT &= ~KINEN_CS_bm(i);
+		_receive(&km.slave[i], _transfer(SYN));
+		KINEN_CS_PORT |= KINEN_CS_bm(i);
+	}
+	KINEN_CS_PORT &= ~KINEN_CS_MASK;
+	for (char *p = km.bcast; *p != NUL; p++) {
+		_transfer(*p);
+	}
+	device.sync_us = sys_get_uptime_us();		// the slaves stamp this LF as well
+	KINEN_CS_PORT |= KINEN_CS_MASK;
+
+	if (km.bcast_sync == true) {
+		sys_sync(km.bcast_phase);
+		km.bcast_sync = false;
+	}
+	km.bcast[0] = NUL;
+}
+
+/*
+ * _parse_response() - store the value from a response line in the aggregate table
+ *
+ *	Responses to the poll requests look like {"r":{"h1tmp":123.456}}, so the 
+ *	value is the number following the last colon.
+ */
+static void _parse_response(kinenSlave_t *s)
+{
+	char *p, *end;
+
+	if ((p = strrchr(s->line, ':')) == NULL) {
+		s->errors++;
+		return;
+	}
+	double value = strtod(++p, &end);
+	if (end == p) {
+		s->errors++;
+		return;
+	}
+	s->value[s->request] = value;
+	s->response_ms = sys_get_uptime_ms();
+}
+#endif // __KINEN_MASTER
@@ -20,6 +20,8 @@
 
 // Kinen definitions and structs
 
+//#define __KINEN_MASTER				// uncomment to build as a Kinen master (SPI master to slave fins)
+
 //#define INPUT_BUFFER_LEN 128
 //#define INPUT_BUFFER_LEN 128
 #define TEXT_BUFFER_LEN 128
@@ -41,10 +43,92 @@ typedef struct kinenSingleton {		// main kinen control struct
 //	char in_buf[INPUT_BUFFER_LEN];	// input text buffer
 //	char out_buf[OUTPUT_BUFFER_LEN];// output text buffer
 
+	uint8_t buf_hwm;				// high-water mark of buf (bytes incl. terminator)
 	char buf[TEXT_BUFFER_LEN];		// input/output text buffer
 } kinenSingleton_t;
 kinenSingleton_t kc;				// allocate kinen controller structure
 
+/*
+ * Kinen master
+ *
+ *	The master drives the SPI bus and selects each slave fin with its own chip select.
+ *	Slaves are polled round-robin from the main loop, a few bytes per slave per pass, 
+ *	so requests to several fins are in flight at once and no pass blocks for long.
+ *	Responses are parsed into an aggregate table (see kinenSlave_t).
+ *
+ *	A broadcast line is sent to all slaves at once and executed without a response.
+ *	It's used to set all zones together and to sync the fins' tick phase.
+ *
+ *	With __KINEN_DRDY the fins' data ready lines are wired together into PB0 (see 
+ *	xio_spi.c). A slave waiting on a response is only polled while that line is low.
+ */
+#ifdef __KINEN_MASTER
+
+#define KINEN_SLAVE_MAX			4				// number of chip select lines
+#define KINEN_CS_PORT			PORTC			// chip selects are PC1 - PC4 (PC0 is the ADC)
+#define KINEN_CS_DDR			DDRC
+#define KINEN_CS_bm(n)			(1<<(PORTC1+(n)))
+#define KINEN_CS_MASK			(KINEN_CS_bm(0) | KINEN_CS_bm(1) | KINEN_CS_bm(2) | KINEN_CS_bm(3))
+#define KINEN_SPI_MODE			(1<<SPE | 1<<MSTR | 1<<CPOL | 1<<CPHA | 1<<SPR0)	// mode 3, fosc/16
+#define KINEN_SPI_OUTBITS		(1<<DDB2 | 1<<DDB3 | 1<<DDB5)	// SS (must be output), MOSI, SCK
+
+//#define __KINEN_DRDY							// fins' data ready lines are wired to PB0
+#define KINEN_DRDY_PORT			PORTB			// data ready input - pulled up here, pulled low by a fin
+#define KINEN_DRDY_PIN			PINB
+#define KINEN_DRDY_bm			(1<<PINB0)
+
+#define KINEN_BYTE_DELAY_US		10				// gap between bytes so the slave ISR can stage the next one
+#define KINEN_BYTES_PER_PASS	8				// max transfers to one slave per main loop pass
+#define KINEN_ENUM_BYTES		4				// transfers used to probe a socket during enumeration
+#define KINEN_POLL_MS			100				// request interval per slave
+#define KINEN_TIMEOUT_MS		50				// time allowed for a response
+#define KINEN_LINE_LEN			32				// response line buffer per slave
+#define KINEN_POLL_COUNT		2				// number of values polled (see kinen.c)
+#define KINEN_BROADCAST_LEN		24				// queued broadcast line
+#define KINEN_BROADCAST_MAX		99999			// largest magnitude value that fits the broadcast line
+
+enum kinenSlaveState {
+	KM_ABSENT = 0,						// nothing in the socket (reads NUL or 0xFF)
+	KM_IDLE,							// present, no request in flight
+	KM_SENDING,							// request is being sent
+	KM_WAITING							// request sent, collecting the response
+};
+
+enum kinenPollValue {					// aggregate table columns - must match kinen_poll[]
+	KM_TEMPERATURE = 0,					// h1tmp
+	KM_STATE							// h1st
+};
+
+typedef struct kinenSlave {				// one entry in the aggregate table
+	uint8_t state;						// see kinenSlaveState
+	uint8_t request;					// poll value in flight (index into kinen_poll[])
+	uint8_t len;						// chars in line
+	const char *tx;						// next request char to send (program memory)
+	uint32_t request_ms;				// uptime when the request started
+	uint32_t response_ms;				// uptime of the last good response
+	uint16_t errors;					// timeouts and unparseable responses
+	double value[KINEN_POLL_COUNT];		// latest polled values
+	char line[KINEN_LINE_LEN];			// response being collected
+} kinenSlave_t;
+
+typedef struct kinenMaster {
+	uint8_t slave_count;				// number of slaves found by enumeration
+	uint8_t next;						// next slave to service (round robin)
+	uint8_t select;						// slave selected for config readout
+	uint8_t bcast_sync;					// queued broadcast is a sync - align the master as well
+	uint16_t bcast_phase;				// sync clock value carried by the sync
+	char bcast[KINEN_BROADCAST_LEN];	// queued broadcast line (NUL if none)
+	kinenSlave_t slave[KINEN_SLAVE_MAX];
+} kinenMaster_t;
+kinenMaster_t km;
+
+uint8_t kinen_callback(void);
+uint8_t kinen_busy(void);
+uint8_t kinen_broadcast(const char *token, double value);
+uint8_t kinen_sync(void);
+
+#endif // __KINEN_MASTER
+
 // function prototypes
 void kinen_init(void);
 
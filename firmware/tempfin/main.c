@@ -21,7 +21,10 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
 
 #include "kinen.h"
 #include "tempfin.h"
@@ -32,12 +35,16 @@
 #include "config.h"
 #include "json_parser.h"
 #include "util.h"
+#include "profiler.h"
+#include "evlog.h"
+#include "alarm.h"
 #include "xio/xio.h"
 
 // local functions
 
 static void _controller(void);
 static uint8_t _dispatch(void);
+static void _idle(void);
 static void _unit_tests(void);
 
 // Had to move the struct definitions and declarations to .h file for reporting purposes
@@ -51,25 +58,34 @@ static void _unit_tests(void);
 int main(void)
 {
 	cli();
+	sys_paint_stack();			// before anything else uses the stack (stack high-water)
 								// system-level inits
 	sys_init();					// do this first
 	xio_init();					// do this second
 	kinen_init();				// do this third
 	cfg_init();
+	al_init();
+	evlog_init();				// find the end of the event log...
+	evlog_event(EV_BOOT, device.reset_flags);	// ...and log the reset
 
 	adc_init(ADC_CHANNEL);		// init system devices
 	pwm_init();
 	tick_init();
+	pwm2_init();				// cooling output - on the tick timer so after tick_init()
 	led_init();
+	prf_init();					// start the profiler cycle counter (if enabled)
+	ac_init();					// overtemperature comparator (if enabled - shares Timer1)
 
 	// application level inits
 	heater_init();				// setup the heater module and subordinate functions
 	sensor_init();
 	sei(); 						// enable interrupts
 	rpt_initialized();			// send initalization string
+								// heater_restore() runs from the first 100 ms tick
 
 //	_unit_tests();				// run any unit tests that are enabled
 	canned_startup();
+	wdt_enable(WDT_TIMEOUT);	// every _controller() pass must finish inside the timeout
 
 	while (true) {				// main loop
 		_controller();
@@ -90,14 +106,31 @@ int main(void)
 #define	RUN(func) if (func == SC_EAGAIN) return; 
 static void _controller()
 {
+	wdt_reset();				// the loop is alive
+	_idle();					// sleep until an interrupt if there is nothing to run
 	RUN(tick_callback());		// regular interval timer clock handler (ticks)
+#ifdef __KINEN_MASTER
+	RUN(kinen_callback());		// poll slave fins (master only)
+#endif
 	RUN(_dispatch());			// read and execute next incoming command
+	RUN(evlog_callback());		// write the event log to EEPROM a byte at a time
+	RUN(evlog_print_callback());// stream the event log a record at a time (see "evl")
+	RUN(cmd_schema_callback());	// stream the config schema a line at a time (see "sch")
 }
 
 static uint8_t _dispatch()
 {
-	ritorno (xio_gets(kc.src, kc.buf, sizeof(kc.buf)));// read line or return if not completed
+	if (xio_line_ready(kc.src) == false) { return (SC_NOOP);}	// RX ISR hasn't seen an LF
+	uint8_t status = xio_gets(kc.src, kc.buf, sizeof(kc.buf));
+	if (status == XIO_BUFFER_FULL) { lat_discard();}	// keep the latency line count in step
+	ritorno (status);								// read line or return if not completed
+	uint8_t len = strlen(kc.buf) + 1;
+	if (len > kc.buf_hwm) { kc.buf_hwm = len;}
+	lat_begin();
+	PRF_BEGIN
 	js_json_parser(kc.buf);
+	PRF_END(PRF_JSON)
+	lat_end();
 	return (SC_OK);
 
 //	if ((status = xio_gets(kc.src, kc.buf, sizeof(kc.buf))) != SC_OK) {
@@ -110,6 +143,52 @@ static uint8_t _dispatch()
 //	}
 }
 
+/*
+ * _idle() - sleep the CPU until the next interrupt if no task is runnable
+ *
+ *	Nothing is runnable if the tick has not fired and no line is waiting on the 
+ *	source device. Characters of a partial line wake the CPU but it goes straight 
+ *	back to sleep. IDLE sleep mode leaves the timers, USART and SPI running
+ *	so any of their interrupts wakes the CPU, which then resumes the loop.
+ *
+ *	Interrupts are off while the run conditions are tested so an ISR can't slip 
+ *	in between the test and the sleep. The instruction after sei() always executes
+ *	before a pending interrupt is serviced, so the wakeup can't be lost.
+ *
+ *	Time spent asleep is accumulated in tick timer counts. tick_1sec() converts 
+ *	this to device.idle_percent, which is readable as the "idle" config value.
+ */
+static void _idle()
+{
+#ifdef __IDLE_SLEEP
+	uint8_t start, end;
+
+	cli();
+	if ((device.tick_count != 0) || (xio_line_ready(kc.src) == true)) {
+		sei();
+		return;
+	}
+#ifdef __KINEN_MASTER
+	if (kinen_busy() == true) {	// master SPI transfers are driven from the loop
+		sei();
+		return;
+	}
+#endif
+	start = TICK_TIMER;
+	sleep_enable();
+	sei();
+	sleep_cpu();				// the waking ISR runs before execution continues here
+	sleep_disable();
+	end = TICK_TIMER;
+
+	if (end >= start) {			// accumulate sleep time, allowing for one timer wrap
+		device.idle_counts += (end - start);
+	} else {
+		device.idle_counts += (end + TICK_COUNT + 1 - start);
+	}
+#endif
+}
+
 /******************************************************************************
  * STARTUP TESTS
  ******************************************************************************/
@@ -0,0 +1,143 @@
+/*
+ * print.c - number and string output without stdio formatting
+ * Part of Kinen project
+ *
+ * Copyright (c) 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY 
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>						// precursor for xio.h
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <avr/pgmspace.h>				// precursor for xio.h
+
+#include "print.h"
+#include "xio/xio.h"
+
+/*
+ * print_ftoa()	  - write a number to buf with a fixed number of decimal places
+ * print_strcpy() - copy a string to buf
+ * print_str()	  - write a string to a stream
+ * print_str_P()  - write a program memory string to a stream
+ * print_float()  - write a number to a stream with a fixed number of decimal places
+ * print_msg_P()  - write a program memory message line in the stream's priority TX lane
+ *
+ *	The buffer writers return a pointer to the terminating NUL so output can be 
+ *	built up by chaining calls, like str += sprintf(str, ...) but without the count.
+ */
+#ifdef __LEAN_PRINT
+
+static const uint32_t print_scale[] PROGMEM = { 1, 10, 100, 1000, 10000 };
+
+/*
+ *	The number is rounded at the last place then split into whole and fraction 
+ *	longs, which are converted with integer divides. AVR '/' and '%' are quick 
+ *	enough that nothing cleverer pays off (see printFloat() in extras/print.c).
+ *	Magnitudes beyond the range of a long print as 4294967295. A float doesn't 
+ *	hold that many digits anyway.
+ */
+char *print_ftoa(char *buf, double n, uint8_t places)
+{
+	char digits[10];
+	uint8_t i = 0;
+	uint32_t whole, fraction;
+
+	if (isnan(n)) { return (print_strcpy(buf, "nan"));}
+	if (n < 0) {
+		*buf++ = '-';
+		n = -n;
+	}
+	if (isinf(n)) { return (print_strcpy(buf, "inf"));}
+	if (places > PRINT_PLACES_MAX) { places = PRINT_PLACES_MAX;}
+	uint32_t scale = pgm_read_dword(&print_scale[places]);
+
+	n += 0.5 / scale;							// round at the last place
+	if (n >= 4294967040.0) {					// largest float below 2^32
+		whole = 0xFFFFFFFF;
+		fraction = 0;
+	} else {
+		whole = (uint32_t)n;
+		fraction = (uint32_t)((n - whole) * scale);
+	}
+	do {										// whole digits come out backwards
+		digits[i++] = (whole % 10) + '0';
+		whole /= 10;
+	} while (whole > 0);
+	while (i > 0) { *buf++ = digits[--i];}
+
+	if (places > 0) {
+		*buf++ = '.';
+		for (i=places; i>0; i--) {				// fill in the places right to left
+			buf[i-1] = (fraction % 10) + '0';
+			fraction /= 10;
+		}
+		buf += places;
+	}
+	*buf = NUL;
+	return (buf);
+}
+
+void print_str(FILE *stream, const char *str)
+{
+	xioDev_t *d = (xioDev_t *)stream->udata;
+	while (*str != NUL) { d->x_putc(*str++, stream);}
+}
+
+void print_str_P(FILE *stream, const char *str)
+{
+	xioDev_t *d = (xioDev_t *)stream->udata;
+	char c;
+	while ((c = pgm_read_byte(str++)) != NUL) { d->x_putc(c, stream);}
+}
+
+#else // stdio versions
+
+/*
+ *	Magnitudes are clamped to the same range as the lean version so the widest 
+ *	result (-4294967295.0000) fits PRINT_FLOAT_LEN. snprintf() backs that up.
+ */
+char *print_ftoa(char *buf, double n, uint8_t places)
+{
+	char format[] = "%0.0f";					// avr-libc printf has no '*' precision
+	if (places > PRINT_PLACES_MAX) { places = PRINT_PLACES_MAX;}
+	format[3] += places;
+	if ((fabs(n) > 4294967295.0) && (isinf(n) == 0)) {
+		n = (n < 0) ? -4294967295.0 : 4294967295.0;
+	}
+	int len = snprintf(buf, PRINT_FLOAT_LEN, format, n);
+	if (len < 0) { len = 0;}
+	if (len >= PRINT_FLOAT_LEN) { len = PRINT_FLOAT_LEN-1;}	// truncated
+	return (buf + len);
+}
+
+void print_str(FILE *stream, const char *str) { fputs(str, stream);}
+void print_str_P(FILE *stream, const char *str) { fputs_P(str, stream);}
+
+#endif // __LEAN_PRINT
+
+char *print_strcpy(char *buf, const char *str)
+{
+	while ((*buf = *str++) != NUL) { buf++;}
+	return (buf);
+}
+
+void print_float(FILE *stream, double n, uint8_t places)
+{
+	char buf[PRINT_FLOAT_LEN];
+	print_ftoa(buf, n, places);
+	print_str(stream, buf);
+}
+
+void print_msg_P(FILE *stream, const char *str)
+{
+	xio_set_priority(stream, true);
+	print_str_P(stream, str);
+	xio_set_priority(stream, false);
+}
@@ -0,0 +1,51 @@
+/*
+ * print.h - number and string output without stdio formatting
+ * Part of Kinen project
+ *
+ * Copyright (c) 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY 
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* --- How it works ---
+ *
+ *	Reports, messages and the JSON serializer do all their output through these 
+ *	functions instead of calling printf, fprintf or sprintf directly.
+ *
+ *	With __LEAN_PRINT defined, numbers are converted with integer and fixed point 
+ *	routines (after printFloat() in extras/print.c) and strings are written 
+ *	straight to the xio device behind the stream. Nothing calls vfprintf, so 
+ *	it and the float printf library drop out of the link. Build with LEAN_PRINT=1
+ *	in default/Makefile to set __LEAN_PRINT and leave out -lprintf_flt.
+ *
+ *	Without __LEAN_PRINT these are thin wrappers around the stdio functions.
+ */
+#ifndef print_h
+#define print_h
+
+/******************************************************************************
+ * PARAMETERS AND SETTINGS
+ ******************************************************************************/
+
+//#define __LEAN_PRINT					// uncomment (or build with LEAN_PRINT=1) to bypass stdio formatting
+
+#define PRINT_FLOAT_LEN		18			// buffer for one number (sign, 10 digits, point, 4 places, NUL)
+#define PRINT_PLACES_MAX	4			// most decimal places print_ftoa() will do
+
+/******************************************************************************
+ * FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+char *print_ftoa(char *buf, double n, uint8_t places);	// returns pointer to the NUL
+char *print_strcpy(char *buf, const char *str);		// returns pointer to the NUL
+void print_str(FILE *stream, const char *str);
+void print_str_P(FILE *stream, const char *str);
+void print_float(FILE *stream, double n, uint8_t places);
+void print_msg_P(FILE *stream, const char *str);	// str must end with a newline
+
+#endif
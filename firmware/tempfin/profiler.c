@@ -0,0 +1,276 @@
+/*
+ * profiler.c - cycle counting profiler for code regions and ISRs
+ * Part of Kinen project
+ *
+ * Copyright (c) 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY 
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>				// precursor for xio.h
+#include <stdbool.h>
+#include <string.h>				// for memset
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "kinen.h"
+#include "system.h"
+#include "profiler.h"
+#include "xio/xio.h"
+
+#ifdef __PROFILER
+
+/*
+ * prf_init() - start Timer1 as a free-running cycle counter
+ *
+ *	Fast PWM mode 14 with TOP at 0xFFFF, clk/1, no interrupts. It counts exactly 
+ *	like normal mode. The mode lets the comparator cutoff use OC1A as a DAC.
+ */
+void prf_init()
+{
+	PRR &= ~PRTIM1_bm;					// Enable Timer1 in the power reduction register (system.h)
+	TCCR1A = (TCCR1A & 0xF0) | TIMER1_MODE_A;// keep OC1A if ac_init() has it (see system.c)
+	TCCR1B = TIMER1_MODE_B;				// no prescaling - counts CPU cycles
+	ICR1 = TIMER1_TOP;
+	TCNT1 = 0;
+	prf_reset();
+	lat.current = LAT_NONE;
+	lat_reset();
+}
+
+/*
+ * prf_reset() - clear statistics for all regions
+ *
+ *	Interrupts are held off so ISR regions don't record into a half-cleared table
+ */
+void prf_reset()
+{
+	uint8_t sreg = SREG;
+	cli();
+	memset(&prf.region, 0, sizeof(prf.region));
+	for (uint8_t i=0; i<PRF_REGION_COUNT; i++) {
+		prf.region[i].min = 0xFFFF;
+	}
+	SREG = sreg;
+}
+
+/*
+ * prf_record() - fold a measurement into a region's statistics
+ *
+ *	Called from main loop regions and from ISRs. Each region is only ever 
+ *	recorded from one context so no locking is needed here.
+ */
+void prf_record(const uint8_t region, const uint16_t cycles)
+{
+	prfStats_t *s = &prf.region[region];
+
+	if (s->count == 0xFFFF) { return;}	// peg rather than let the average drift
+	s->count++;
+	s->sum += cycles;
+	if (cycles < s->min) { s->min = cycles;}
+	if (cycles > s->max) { s->max = cycles;}
+}
+
+/*
+ * prf_get_stats() - atomic copy of a region's statistics
+ */
+void prf_get_stats(const uint8_t region, prfStats_t *stats)
+{
+	uint8_t sreg = SREG;
+	cli();
+	memcpy(stats, &prf.region[region], sizeof(prfStats_t));
+	SREG = sreg;
+}
+
+/*
+ * lat_reset() - clear the latency histograms
+ *
+ *	Commands in progress are left alone and are recorded when they finish.
+ */
+void lat_reset()
+{
+	memset(&lat.phase, 0, sizeof(lat.phase));
+}
+
+/*
+ * lat_rx_lf() - stamp an LF written into a device's RX buffer (called from RX ISRs)
+ */
+void lat_rx_lf(const uint8_t dev)
+{
+	if (dev != kc.src) { return;}
+	lat.lf_us[lat.lf_count & (LAT_LF_STAMPS-1)] = sys_get_uptime_us();
+	lat.lf_count++;
+}
+
+/*
+ * _tx_lane()	 - the TX lane responses are written to (see json_parser.c)
+ * lat_tx_sent() - check for the end of a response (called from TX ISRs)
+ *
+ *	Only called while some record is sending (see LAT_TX_SENT). The read index 
+ *	stops on the character it returned, so it reaches tx_end when the last 
+ *	character of the response has been taken - normal lane characters don't move it.
+ */
+static xioBuf_t *_tx_lane()
+{
+	xioDev_t *d = (xioDev_t *)stderr->udata;
+	return ((d->txp != NULL) ? d->txp : d->tx);
+}
+
+void lat_tx_sent(const uint8_t dev)
+{
+	if (dev != xio_get_dev(stderr)) { return;}
+	xioBuf_t *b = _tx_lane();
+	for (uint8_t i=0; i<LAT_RECORDS; i++) {
+		latRecord_t *r = &lat.rec[i];
+		if (r->state != LAT_SENDING) { continue;}
+		if (b->rd != r->tx_end) { continue;}
+		r->tx_us = sys_get_uptime_us();
+		r->state = LAT_SENT;
+		lat.sending--;
+	}
+}
+
+/*
+ * _record() - fold one time into a phase's histogram
+ * _fold()	 - fold and free every record whose response has been sent
+ */
+static void _record(const uint8_t phase, uint32_t us)
+{
+	latHist_t *h = &lat.phase[phase];
+	uint8_t bucket = 0;
+
+	if (us > h->max) { h->max = us;}
+	for (us >>= LAT_BUCKET_SHIFT; (us != 0) && (bucket < LAT_BUCKETS-1); us >>= 1) {
+		bucket++;
+	}
+	if (h->bucket[bucket] != 0xFFFF) { h->bucket[bucket]++;}
+}
+
+static void _fold()
+{
+	for (uint8_t i=0; i<LAT_RECORDS; i++) {
+		latRecord_t *r = &lat.rec[i];
+		if (r->state != LAT_SENT) { continue;}
+		_record(LAT_QUEUED, r->parse_us - r->lf_us);
+		_record(LAT_EXEC, r->exec_us - r->parse_us);
+		_record(LAT_TX, r->tx_us - r->exec_us);
+		_record(LAT_TOTAL, r->tx_us - r->lf_us);
+		r->state = LAT_FREE;
+	}
+}
+
+/*
+ * lat_begin()	 - a line has been read from the source device and is about to be parsed
+ * lat_discard() - a line has been thrown away unparsed (too long)
+ *
+ *	Lines are matched to their LF stamps by count. A line with no LF counted (its 
+ *	LF was lost to a full RX buffer and it ran into the next one) doesn't advance 
+ *	the count, and a line whose stamp has been overwritten isn't recorded.
+ */
+static uint8_t _next_line(uint32_t *lf_us)
+{
+	uint8_t sreg = SREG;
+	cli();
+	uint8_t waiting = lat.lf_count - lat.lines;
+	*lf_us = lat.lf_us[lat.lines & (LAT_LF_STAMPS-1)];
+	SREG = sreg;
+
+	if (waiting == 0) { return (false);}
+	lat.lines++;
+	return (waiting <= LAT_LF_STAMPS);
+}
+
+void lat_begin()
+{
+	uint32_t lf_us;
+
+	_fold();
+	lat.current = LAT_NONE;
+	if (_next_line(&lf_us) == false) { return;}
+	for (uint8_t i=0; i<LAT_RECORDS; i++) {
+		latRecord_t *r = &lat.rec[i];
+		if (r->state != LAT_FREE) { continue;}
+		r->lf_us = lf_us;
+		r->parse_us = sys_get_uptime_us();
+		r->state = LAT_EXECUTING;
+		lat.current = i;
+		return;
+	}
+}
+
+void lat_discard()
+{
+	uint32_t lf_us;
+	_next_line(&lf_us);
+}
+
+/*
+ * lat_exec() - execution of the current command is done (response not yet serialized)
+ * lat_end()  - the response is in the TX buffer
+ */
+void lat_exec()
+{
+	if (lat.current == LAT_NONE) { return;}
+	lat.rec[lat.current].exec_us = sys_get_uptime_us();
+}
+
+void lat_end()
+{
+	if (lat.current == LAT_NONE) { return;}
+	latRecord_t *r = &lat.rec[lat.current];
+	lat.current = LAT_NONE;
+
+	uint8_t sreg = SREG;
+	cli();
+	xioBuf_t *b = _tx_lane();
+	r->tx_end = b->wr;
+	if (b->rd == b->wr) {				// no response, or it's already gone
+		r->tx_us = sys_get_uptime_us();
+		r->state = LAT_SENT;
+	} else {
+		r->state = LAT_SENDING;
+		lat.sending++;
+	}
+	SREG = sreg;
+}
+
+/*
+ * lat_get_stats()		- fold finished commands and copy a phase's histogram
+ * lat_get_count()		- number of times in a histogram
+ * lat_get_percentile() - upper edge of the bucket holding the percentile (max for the last)
+ */
+void lat_get_stats(const uint8_t phase, latHist_t *hist)
+{
+	_fold();
+	memcpy(hist, &lat.phase[phase], sizeof(latHist_t));
+}
+
+uint32_t lat_get_count(const latHist_t *hist)
+{
+	uint32_t count = 0;
+	for (uint8_t i=0; i<LAT_BUCKETS; i++) { count += hist->bucket[i];}
+	return (count);
+}
+
+uint32_t lat_get_percentile(const latHist_t *hist, const uint8_t percent)
+{
+	uint32_t want = (lat_get_count(hist) * percent + 99) / 100;
+	uint32_t count = 0;
+
+	if (want == 0) { return (0);}
+	for (uint8_t i=0; i<LAT_BUCKETS-1; i++) {
+		if ((count += hist->bucket[i]) >= want) {
+			uint32_t edge = 1UL << (i + LAT_BUCKET_SHIFT);
+			return ((edge < hist->max) ? edge : hist->max);
+		}
+	}
+	return (hist->max);
+}
+
+#endif // __PROFILER
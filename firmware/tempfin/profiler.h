@@ -0,0 +1,181 @@
+/*
+ * profiler.h - cycle counting profiler for code regions and ISRs
+ * Part of Kinen project
+ *
+ * Copyright (c) 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY 
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* --- How it works ---
+ *
+ *	Timer1 runs free at the CPU clock (no prescaler) so one count is one cycle.
+ *	It's shared with the overtemperature comparator's DAC (see ac_init()).
+ *	A region is bracketed by PRF_BEGIN and PRF_END(region). The elapsed count is 
+ *	folded into the region's count, min, max and sum. Regions longer than 65535 
+ *	cycles (4 ms at 16 MHz) wrap and will read short.
+ *
+ *	Main loop regions include the time spent in any ISRs that preempt them.
+ *	ISR regions measure the ISR body only - not the vector entry and exit.
+ *
+ *	It's a development build option: uncomment __PROFILER to compile it in. It 
+ *	costs about 210 bytes of RAM (prf and lat) and adds hooks to every USART and 
+ *	SPI ISR, so it's left out of production builds. Without it all of this compiles 
+ *	to nothing and the cfgArray "prf", "lt" and "lh" groups are removed.
+ */
+/* --- Command latency ---
+ *
+ *	Each command line from the source device (kc.src) is timestamped with 
+ *	sys_get_uptime_us() (4 us resolution) at four points:
+ *
+ *	  - in the RX ISR that writes its LF into the RX buffer
+ *	  - in _dispatch() as parsing starts
+ *	  - in js_json_parser() when execution ends, before the response is serialized
+ *	  - in the TX ISR that takes the last character of the response from its TX lane
+ *
+ *	The time between stamps is folded into one log2 histogram per phase, plus one 
+ *	for the whole trip. Bucket 0 counts times under 64 us, bucket n counts 2^(n+5) 
+ *	to 2^(n+6) us and the last bucket counts everything from 16 ms up. The "lt" 
+ *	group reads the count, p50, p99 and max of the phase selected by ltid (p50 and 
+ *	p99 are the upper edge of their bucket). "lh" reads that phase's buckets.
+ *
+ *	The RX ISR keeps LF times for the last LAT_LF_STAMPS lines by line number, so 
+ *	lines waiting behind a slow command keep their own arrival times. Responses go 
+ *	to the priority lane of the response stream (stderr), which isn't always the 
+ *	source device - a slave reads USART and answers on SPI. A response is out when 
+ *	the TX ISR of that device takes the last character that was in that lane when 
+ *	the response was written. Reports sent from the normal lane meanwhile don't 
+ *	count. Up to LAT_RECORDS commands can be in progress at once - any more aren't 
+ *	recorded.
+ */
+#ifndef profiler_h
+#define profiler_h
+
+/******************************************************************************
+ * PARAMETERS AND SETTINGS
+ ******************************************************************************/
+
+//#define __PROFILER					// uncomment to build the profiler in (about 210 bytes of RAM)
+
+enum prfRegion {						// instrumented regions
+	PRF_SENSOR = 0,						// sensor_callback()
+	PRF_HEATER,							// heater_callback()
+	PRF_JSON,							// js_json_parser()
+	PRF_USART_RX,						// USART RX ISR
+	PRF_USART_TX,						// USART TX (UDRE) ISR
+	PRF_SPI,							// SPI transfer complete ISR
+	PRF_REGION_COUNT					// must be last
+};
+
+enum latPhase {							// command latency phases
+	LAT_QUEUED = 0,						// LF received to parse start (waiting in the RX buffer)
+	LAT_EXEC,							// parse start to end of execution
+	LAT_TX,								// end of execution to last response character sent
+	LAT_TOTAL,							// LF received to last response character sent
+	LAT_PHASE_COUNT						// must be last
+};
+
+#define LAT_BUCKETS 10					// histogram buckets per phase
+#define LAT_BUCKET_SHIFT 6				// bucket 0 is under 2^6 us
+#define LAT_LF_STAMPS 4					// LF times kept by the RX ISR (must be a power of 2)
+#define LAT_RECORDS 2					// commands that can be in progress at once
+#define LAT_NONE 0xFF					// no record for the current command
+
+/******************************************************************************
+ * STRUCTURES 
+ ******************************************************************************/
+
+#ifdef __PROFILER
+
+typedef struct prfRegionStats {			// statistics for one region (in cycles)
+	uint16_t count;						// number of samples (pegs at max)
+	uint16_t min;
+	uint16_t max;
+	uint32_t sum;						// for the average
+} prfStats_t;
+
+typedef struct prfSingleton {
+	uint8_t select;						// region selected for config readout
+	prfStats_t region[PRF_REGION_COUNT];
+} prf_t;
+prf_t prf;
+
+typedef struct latHistogram {			// one phase (in microseconds)
+	uint16_t bucket[LAT_BUCKETS];		// each pegs at max
+	uint32_t max;
+} latHist_t;
+
+enum latRecordState {
+	LAT_FREE = 0,
+	LAT_EXECUTING,						// parsed, not yet executed
+	LAT_SENDING,						// response is in the TX buffer
+	LAT_SENT							// ready to fold into the histograms
+};
+
+typedef struct latRecord {				// timestamps for one command
+	volatile uint8_t state;
+	uint8_t tx_end;						// TX lane index of the response's last character
+	uint32_t lf_us;
+	uint32_t parse_us;
+	uint32_t exec_us;
+	volatile uint32_t tx_us;			// set by the TX ISR
+} latRecord_t;
+
+typedef struct latSingleton {
+	uint8_t select;						// phase selected for config readout
+	uint8_t current;					// record of the command being executed or LAT_NONE
+	uint8_t lines;						// lines read by _dispatch()
+	volatile uint8_t lf_count;			// LFs received (RX ISR)
+	volatile uint8_t sending;			// records in LAT_SENDING
+	volatile uint32_t lf_us[LAT_LF_STAMPS];// LF times indexed by line number
+	latRecord_t rec[LAT_RECORDS];
+	latHist_t phase[LAT_PHASE_COUNT];
+} lat_t;
+lat_t lat;
+
+/******************************************************************************
+ * FUNCTION PROTOTYPES AND MACROS
+ ******************************************************************************/
+
+#define PRF_BEGIN uint16_t prf_begin = TCNT1;
+#define PRF_END(r) prf_record(r, TCNT1 - prf_begin);
+
+void prf_init(void);
+void prf_reset(void);
+void prf_record(const uint8_t region, const uint16_t cycles);
+void prf_get_stats(const uint8_t region, prfStats_t *stats);
+
+#define LAT_RX_LF(dev) lat_rx_lf(dev);
+#define LAT_TX_SENT(dev) if (lat.sending != 0) { lat_tx_sent(dev);}
+
+void lat_reset(void);
+void lat_begin(void);
+void lat_discard(void);
+void lat_exec(void);
+void lat_end(void);
+void lat_rx_lf(const uint8_t dev);
+void lat_tx_sent(const uint8_t dev);
+void lat_get_stats(const uint8_t phase, latHist_t *hist);
+uint32_t lat_get_count(const latHist_t *hist);
+uint32_t lat_get_percentile(const latHist_t *hist, const uint8_t percent);
+
+#else
+
+#define PRF_BEGIN
+#define PRF_END(r)
+#define prf_init()
+#define LAT_RX_LF(dev)
+#define LAT_TX_SENT(dev)
+#define lat_begin()
+#define lat_discard()
+#define lat_exec()
+#define lat_end()
+
+#endif // __PROFILER
+
+#endif
@@ -24,6 +24,7 @@
 #include "report.h"
 #include "sensor.h"
 #include "heater.h"
+#include "print.h"
 //#include "tempfin.h"
 //#include "xio/xio.h"
 
@@ -35,7 +36,8 @@ static const char msg_scode1[] PROGMEM = "  Taking Reading";
 static const char msg_scode2[] PROGMEM = "  Bad Reading";
 static const char msg_scode3[] PROGMEM = "  Disconnected";
 static const char msg_scode4[] PROGMEM = "  No Power";
-static PGM_P const msg_scode[] PROGMEM = { msg_scode0, msg_scode1, msg_scode2, msg_scode3, msg_scode4 };
+static const char msg_scode5[] PROGMEM = "  Slew";
+static PGM_P const msg_scode[] PROGMEM = { msg_scode0, msg_scode1, msg_scode2, msg_scode3, msg_scode4, msg_scode5 };
 
 static const char msg_hstate0[] PROGMEM = "  OK";
 static const char msg_hstate1[] PROGMEM = "  Shutdown";
@@ -44,24 +46,31 @@ static const char msg_hstate3[] PROGMEM = "  REGULATED";
 static PGM_P const msg_hstate[] PROGMEM = { msg_hstate0, msg_hstate1, msg_hstate2, msg_hstate3 };
 
 /*** Display routines ***/
+static void _readout_value(const char *label, double value)	// prints e.g. "Temp:123.456  "
+{
+	print_str_P(stdout, label);
+	print_float(stdout, value, 3);
+	print_str_P(stdout, PSTR("  "));
+}
+
 void rpt_initialized()
 {
-	printf_P(PSTR("\nDevice Initialized %1.0f\n"),42);
+	print_str_P(stdout, PSTR("\nDevice Initialized 42\n"));
 }
 
 void rpt_readout()
 {
-	printf_P(PSTR("Temp:%1.3f  "), 		sensor.temperature);
-	printf_P(PSTR("PWM:%1.3f  "),		pid.output);
-//	printf_P(PSTR("s[0]:%1.3f  "), 		sensor.sample[0]);
-	printf_P(PSTR("StdDev:%1.3f  "),	sensor.std_dev);
-//	printf_P(PSTR("Samples:%1.3f  "),	sensor.samples);
-	printf_P(PSTR("Err:%1.3f  "),		pid.error);
-	printf_P(PSTR("I:%1.3f  "),			pid.integral);
-//	printf_P(PSTR("D:%1.3f  "),			pid.derivative);
-//	printf_P(PSTR("Hy:%1.3f  "),		heater.hysteresis);
+	_readout_value(PSTR("Temp:"),	sensor.temperature);
+	_readout_value(PSTR("PWM:"),	pid.output);
+//	_readout_value(PSTR("s[0]:"),	sensor.sample[0]);
+	_readout_value(PSTR("StdDev:"),	sensor.std_dev);
+//	_readout_value(PSTR("Samples:"),sensor.samples);
+	_readout_value(PSTR("Err:"),	pid.error);
+	_readout_value(PSTR("I:"),		pid.integral);
+//	_readout_value(PSTR("D:"),		pid.derivative);
+//	_readout_value(PSTR("Hy:"),		heater.hysteresis);
 
-	printf_P((PGM_P)pgm_read_word(&msg_hstate[heater.state]));
-//	printf_P((PGM_P)pgm_read_word(&msg_scode[sensor.code]));
-	printf_P(PSTR("\n")); 
+	print_str_P(stdout, (PGM_P)pgm_read_word(&msg_hstate[heater.state]));
+//	print_str_P(stdout, (PGM_P)pgm_read_word(&msg_scode[sensor.code]));
+	print_str_P(stdout, PSTR("\n")); 
 }
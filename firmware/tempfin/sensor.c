@@ -36,6 +36,7 @@
 //#include "xio/xio.h"
 
 static inline double _sensor_sample(uint8_t adc_channel);
+static void _sensor_check_sample(double sample);
 
 /**** Temperature Sensor and Functions ****/
 /*
@@ -56,12 +57,16 @@ void sensor_init()
 	sensor.reading_variance_max = SENSOR_READING_VARIANCE_MAX;
 	sensor.disconnect_temperature = SENSOR_DISCONNECTED_TEMPERATURE;
 	sensor.no_power_temperature = SENSOR_NO_POWER_TEMPERATURE;
+	sensor.slew_max = SENSOR_SLEW_MAX;
 	// note: there are no bits to set to outputs in this initialization
 }
 
 void sensor_on()
 {
 	sensor.state = SENSOR_NO_DATA;
+	sensor.code = SENSOR_IDLE;
+	sensor.bad_samples = 0;
+	sensor.last_sample = LESS_THAN_ZERO;
 }
 
 void sensor_off()
@@ -71,6 +76,7 @@ void sensor_off()
 
 void sensor_start_reading() 
 { 
+	if (sensor.state == SENSOR_FAULT) { return;}	// latched until sensor_on()
 	sensor.sample_idx = 0;
 	sensor.code = SENSOR_TAKING_READING;
 }
@@ -97,6 +103,10 @@ double sensor_get_temperature()
  *	It's set up to collect 9 samples at 10 ms intervals to serve a 100ms heater 
  *	loop. Each sampling interval must be requested explicitly by calling 
  *	sensor_start_sample(). It does not free-run.
+ *
+ *	Each sample is also checked on its own as it's taken (see _sensor_check_sample()) 
+ *	so an open or shorted thermocouple cuts the heater within a couple of samples 
+ *	instead of waiting for the reading and the heater's bad reading count.
  */
 void sensor_callback()
 {
@@ -106,7 +116,10 @@ void sensor_callback()
 	}
 
 	// get a sample and return if still in the reading period
-	sensor.sample[sensor.sample_idx] = _sensor_sample(ADC_CHANNEL);
+	double sample = _sensor_sample(ADC_CHANNEL);
+	_sensor_check_sample(sample);
+	if (sensor.state == SENSOR_FAULT) { return;}
+	sensor.sample[sensor.sample_idx] = sample;
 	if ((++sensor.sample_idx) < SENSOR_SAMPLES) { return; }
 
 	// process the array to clean up samples
@@ -131,16 +144,48 @@ void sensor_callback()
 	sensor.state = SENSOR_HAS_DATA;
 	sensor.code = SENSOR_IDLE;			// we are done. Flip it back to idle
 
-	// process the exception cases
-	if (sensor.temperature > SENSOR_DISCONNECTED_TEMPERATURE) {
+	// process the exception cases - same limits as the per-sample check
+	if (sensor.temperature > sensor.disconnect_temperature) {
 		sensor.state = SENSOR_ERROR;
 		sensor.code = SENSOR_ERROR_DISCONNECTED;
-	} else if (sensor.temperature < SENSOR_NO_POWER_TEMPERATURE) {
+	} else if (sensor.temperature < sensor.no_power_temperature) {
 		sensor.state = SENSOR_ERROR;
 		sensor.code = SENSOR_ERROR_NO_POWER;
 	}
 }
 
+/*
+ * _sensor_check_sample() - range and slew check one sample; latch a fault if it persists
+ *
+ *	A sample is bad if it's outside the disconnected / no power temperatures or 
+ *	if it's moved more than slew_max from the last good sample. A thermocouple 
+ *	that opens or shorts drives the amplifier to a rail, which fails one or both.
+ *	A single spike is forgiven. SENSOR_FAULT_SAMPLES in a row latch SENSOR_FAULT 
+ *	and drive the PWM output off right here - heater_callback() shuts the heater 
+ *	down on its next pass. The latch holds until sensor_on().
+ */
+static void _sensor_check_sample(double sample)
+{
+	uint8_t code;
+
+	if (sample > sensor.disconnect_temperature) {
+		code = SENSOR_ERROR_DISCONNECTED;
+	} else if (sample < sensor.no_power_temperature) {
+		code = SENSOR_ERROR_NO_POWER;
+	} else if ((sensor.last_sample > LESS_THAN_ZERO) && 
+			   (fabs(sample - sensor.last_sample) > sensor.slew_max)) {
+		code = SENSOR_ERROR_SLEW;
+	} else {
+		sensor.last_sample = sample;
+		sensor.bad_samples = 0;
+		return;
+	}
+	if (++sensor.bad_samples < SENSOR_FAULT_SAMPLES) { return;}
+	pwm_set_duty(0);
+	sensor.state = SENSOR_FAULT;
+	sensor.code = code;
+}
+
 /*
  * _sensor_sample() - take a sample and reject samples showing excessive variance
  *
@@ -28,6 +28,8 @@
 #define SENSOR_READING_VARIANCE_MAX 	20		// reject entire reading if std_dev exceeds this amount
 #define SENSOR_NO_POWER_TEMPERATURE 	-2		// detect thermocouple amplifier disconnected if readings stay below this temp
 #define SENSOR_DISCONNECTED_TEMPERATURE 400		// sensor is DISCONNECTED if over this temp (works w/ both 5v and 3v refs)
+#define SENSOR_SLEW_MAX 				20		// a sample that moves more than this from the last good one is bad (deg C)
+#define SENSOR_FAULT_SAMPLES			2		// successive bad samples that latch a sensor fault
 #define SENSOR_TICK_SECONDS 			0.01	// 10 ms
 
 #define SENSOR_SLOPE 		0.489616568		// derived from AD597 chart between 80 deg-C and 300 deg-C
@@ -42,7 +44,8 @@ enum tcSensorState {						// main state machine
 	SENSOR_OFF = 0,							// sensor is off or uninitialized
 	SENSOR_NO_DATA,							// interim state before first reading is complete
 	SENSOR_ERROR,							// a sensor error occurred. Don't use the data
-	SENSOR_HAS_DATA							// sensor has valid data
+	SENSOR_HAS_DATA,						// sensor has valid data
+	SENSOR_FAULT							// bad samples latched a fault and cut PWM. Cleared by sensor_on()
 };
 
 enum tcSensorCode {							// success and failure codes
@@ -50,7 +53,8 @@ enum tcSensorCode {							// success and failure codes
 	SENSOR_TAKING_READING,					// sensor is taking samples for a reading
 	SENSOR_ERROR_BAD_READINGS,				// ERROR: too many number of bad readings
 	SENSOR_ERROR_DISCONNECTED,				// ERROR: thermocouple detected as disconnected
-	SENSOR_ERROR_NO_POWER					// ERROR: detected lack of power to thermocouple amplifier
+	SENSOR_ERROR_NO_POWER,					// ERROR: detected lack of power to thermocouple amplifier
+	SENSOR_ERROR_SLEW						// ERROR: samples jumped faster than the heater can move
 };
 
 /******************************************************************************
@@ -64,12 +68,15 @@ typedef struct SensorStruct {
 	uint8_t code;				// sensor return code (more information about state)
 	uint8_t sample_idx;			// index into sample array
 	uint8_t samples;			// number of samples in final average
+	uint8_t bad_samples;		// successive samples failing the range or slew checks
 	double temperature;			// high confidence temperature reading
 	double std_dev;				// standard deviation of sample array
 	double sample_variance_max;	// sample deviation above which to reject a sample
 	double reading_variance_max;// standard deviation to reject the entire reading
 	double disconnect_temperature;	// bogus temperature indicates thermocouple is disconnected
 	double no_power_temperature;	// bogus temperature indicates no power to thermocouple amplifier
+	double slew_max;			// largest believable change between samples
+	double last_sample;			// last sample that passed the checks (LESS_THAN_ZERO if none)
 	double sample[SENSOR_SAMPLES];	// array of sensor samples in a reading
 	double test;
 } sensor_t;
@@ -18,6 +18,8 @@
 #include <stdbool.h>
 #include <avr/pgmspace.h> 
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
 //#include <avr/io.h>
 //#include <math.h>
 
@@ -25,16 +27,80 @@
 #include "system.h"
 #include "sensor.h"
 #include "heater.h"
+#include "profiler.h"
+#include "config.h"
+#include "alarm.h"
+
+/**** sys_save_reset_flags() - capture the reset cause and stop the watchdog ****
+ *
+ *	A watchdog reset leaves the watchdog running at its shortest period, so it 
+ *	has to be stopped before the C startup code has a chance to trip it again. 
+ *	WDRF must be cleared first or the watchdog can't be turned off. This runs in 
+ *	.init3 with no stack frame, before .bss is cleared, so the flags are kept in 
+ *	.noinit and copied to device.reset_flags by sys_init().
+ */
+static uint8_t sys_reset_flags __attribute__ ((section (".noinit")));
+
+void sys_save_reset_flags(void) __attribute__ ((naked, used, section (".init3")));
+void sys_save_reset_flags(void)
+{
+	sys_reset_flags = MCUSR;
+	MCUSR = 0;
+	wdt_disable();
+}
 
 /**** sys_init() - lowest level hardware init ****/
 
 void sys_init() 
 {
+	device.reset_flags = sys_reset_flags;
 	PRR = 0xFF;					// turn off all peripherals. Each device needs to enble itself
 
 	DDRB = 0x00;				// initialize all ports as inputs. Each device sets its own outputs
 	DDRC = 0x00;
 	DDRD = 0x00;
+
+	set_sleep_mode(SLEEP_MODE_IDLE);	// IDLE keeps timers, USART and SPI running
+}
+
+/**** Stack and RAM measurement ****
+ * sys_paint_stack()	- fill unused RAM with the canary value at startup
+ * sys_get_free_stack() - return the minimum free stack since reset
+ * sys_get_free_ram()	- return the current free RAM between heap and stack
+ *
+ *	Painting is the first thing main() does, before interrupts are enabled. It 
+ *	paints from the end of .bss (_end) up to its own frame - the few bytes main() 
+ *	and the paint call use above that are in use from the start anyway. There is
+ *	no malloc in this firmware so the heap is empty and all of this is stack space.
+ *	The stack grows down into the painted area and leaves non-canary bytes behind. 
+ *	Counting canaries up from _end gives the smallest headroom there has ever been.
+ */
+extern uint8_t _end;
+extern uint8_t __stack;
+
+void sys_paint_stack(void)
+{
+	uint8_t top;								// lives at the current stack pointer
+	uint8_t *p = &_end;
+	while (p < &top) { *p++ = STACK_CANARY;}
+}
+
+uint16_t sys_get_free_stack(void)
+{
+	const uint8_t *p = &_end;
+	uint16_t count = 0;
+
+	while ((p <= &__stack) && (*p == STACK_CANARY)) {	// bound first - don't read past the top
+		p++;
+		count++;
+	}
+	return (count);
+}
+
+uint16_t sys_get_free_ram(void)
+{
+	uint8_t top;								// lives at the current stack pointer
+	return ((uint16_t)(&top - &_end));
 }
 
 // Atmega328P data direction defines: 0=input pin, 1=output pin
@@ -153,10 +219,112 @@ uint8_t pwm_set_duty(double duty)
 	return (SC_OK);
 }
 
+/*
+ * pwm2_init() 	   - set up the secondary (cooling) PWM channel
+ * pwm2_set_duty() - set its duty cycle. 0 turns it off
+ *
+ *	The channel is OC0B on the tick timer. Timer0 runs in fast PWM mode 7, which 
+ *	counts 0 to OCR0A just like CTC mode does, so the tick is unchanged and OC0B 
+ *	gets a PWM at the 1 KHz tick rate with TICK_COUNT+1 steps. tick_init() must 
+ *	run first. At 0% and 100% the pin is taken from the timer and set directly 
+ *	so there are no glitches at the ends.
+ */
+void pwm2_init(void)
+{
+	PWM2_DDR |= PWM2_OUT2B;
+	pwm2_set_duty(0);
+}
+
+uint8_t pwm2_set_duty(double duty)
+{
+	if (duty < 0.01) {
+		TCCR0A &= ~PWM2_COM;
+		PWM2_PORT &= ~PWM2_OUT2B;
+	} else if (duty > 99.9) {
+		TCCR0A &= ~PWM2_COM;
+		PWM2_PORT |= PWM2_OUT2B;
+	} else {
+		OCR0B = (uint8_t)((TICK_COUNT + 1) * (duty / 100));
+		TCCR0A |= PWM2_COM;
+	}
+	return (SC_OK);
+}
+
+
+/**** Analog Comparator Functions ****/
+/*
+ * ac_init()		  - set up the overtemperature comparator and its threshold DAC
+ * ac_set_threshold() - set the cutoff from the software overheat temperature
+ * ac_arm()			  - clear a trip. Returns false if it's over the cutoff right now
+ * ANALOG_COMP ISR()  - cut the heater
+ *
+ *	This is a backstop for the overheat check in heater_callback(), which only runs 
+ *	every 100 ms and only while the main loop is alive. The thermocouple amplifier 
+ *	output is wired to AIN1 (PD7) as well as to the ADC. The threshold is a voltage 
+ *	on AIN0 (PD6) made by filtering a PWM on OC1A (PB1) through an RC. The RC must 
+ *	settle before the heater is first turned on or ac_arm() will refuse it - that's 
+ *	why heater_restore() waits for the first 100 ms callout.
+ *
+ *	Timer1 is shared with the profiler. Fast PWM mode 14 with ICR1 at 0xFFFF counts 
+ *	0 to 0xFFFF at the CPU clock just like normal mode does. 
+ *
+ *	The comparator output falls when AIN1 rises above AIN0. The ISR disconnects 
+ *	OC2B and drives the heater pin low a few cycles later without the main loop. 
+ *	heater_callback() sees the trip and shuts the heater down. pwm_init() hooks 
+ *	OC2B back up, so heater_on() re-arms the comparator before it calls pwm_on().
+ */
+#ifdef __AC_CUTOFF
+void ac_init(void)
+{
+	PRR &= ~PRTIM1_bm;					// Enable Timer1 in the power reduction register (system.h)
+	TCCR1A = TIMER1_MODE_A | (1<<COM1A1);// non-inverted PWM on OC1A
+	TCCR1B = TIMER1_MODE_B;
+	ICR1 = TIMER1_TOP;
+	AC_DAC_DDR |= AC_DAC_OUT;
+	DIDR1 = AC_INPUTS_bm;
+	ADCSRB &= ~(1<<ACME);				// negative input is the AIN1 pin, not the ADC mux
+	ACSR = (1<<ACI) | (1<<ACIS1);		// positive input is AIN0, interrupt on falling output
+	ACSR |= (1<<ACIE);
+}
+
+void ac_set_threshold(double temperature)
+{
+	// same line as the sensor's conversion, scaled from 10 bit ADC counts to the 16 bit DAC
+	double dac = ((temperature + AC_MARGIN - SENSOR_OFFSET) / SENSOR_SLOPE) * 64;
+	if (dac > TIMER1_TOP) { dac = TIMER1_TOP;}
+	if (dac < 0) { dac = 0;}
+
+	uint8_t sreg = SREG;				// 16 bit register write
+	cli();
+	OCR1A = (uint16_t)dac;
+	SREG = sreg;
+}
+
+uint8_t ac_arm(void)
+{
+	ACSR |= (1<<ACI);					// clear a stale edge
+	if ((ACSR & (1<<ACO)) == 0) {		// AIN1 is already above AIN0
+		device.ac_tripped = true;
+		return (false);
+	}
+	device.ac_tripped = false;
+	return (true);
+}
+
+ISR(ANALOG_COMP_vect)
+{
+	TCCR2A &= ~PWM_OUTB_COM;			// take the pin away from the timer...
+	PWM_PORT &= ~PWM_OUTB;				// ...and drive it low
+	device.ac_tripped = true;
+}
+#endif // __AC_CUTOFF
 
 /**** Tick - Tick tock - Regular Interval Timer Clock Functions ****
  * tick_init() 	  - initialize RIT timers and data
  * RIT ISR()	  - RIT interrupt routine 
+ * sys_get_uptime_ms() - return milliseconds since startup
+ * sys_get_uptime_us() - return microseconds since startup (wraps every ~71 minutes)
+ * sys_sync()	  - align the tick phase and callouts to a broadcast sync
  * tick_callback() - run RIT from dispatch loop
  * tick_10ms()	  - tasks that run every 10 ms
  * tick_100ms()	  - tasks that run every 100 ms
@@ -166,7 +334,7 @@ void tick_init(void)
 {
 	PRR &= ~PRTIM0_bm;				// Enable Timer0 in the power reduction register (system.h)
 	TCCR0A = TICK_MODE;				// mode_settings
-	TCCR0B = TICK_PRESCALER;		// 1024 ~= 7800 Hz
+	TCCR0B = TICK_PRESCALER;		// 64x = 250 KHz at 16 MHz
 	OCR0A = TICK_COUNT;
 	TIMSK0 = (1<<OCIE0A);			// enable compare interrupts
 	device.tick_10ms_count = 10;
@@ -176,34 +344,118 @@ void tick_init(void)
 
 ISR(TIMER0_COMPA_vect)
 {
-	device.tick_flag = true;
+	device.uptime_ms++;
+	if (device.tick_count != 0xFF) { device.tick_count++;}	// saturate rather than wrap
+}
+
+uint32_t sys_get_uptime_ms(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+	uint32_t ms = device.uptime_ms;
+	SREG = sreg;
+	return (ms);
+}
+
+uint32_t sys_get_uptime_us(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+	uint32_t ms = device.uptime_ms;
+	uint8_t count = TICK_TIMER;
+	if ((TIFR0 & (1<<OCF0A)) && (count < TICK_COUNT)) { ms++;}	// timer wrapped but ISR is still pending
+	SREG = sreg;
+	return ((ms * 1000) + (count * TICK_US_PER_COUNT));
+}
+
+/*
+ *	sys_sync() aligns this fin's tick to the LF of the last broadcast line, which 
+ *	every fin receives in the same SPI byte (see xio_spi.c). The tick timer phase 
+ *	is set as if a tick had fired at the LF. The callout dividers are reloaded so 
+ *	the 10ms, 100ms and 1 sec callouts fall on multiples of their period of a sync 
+ *	clock that read phase_ms at the LF. Fins synced together run their heater loops 
+ *	and sensor sampling windows in step. 
+ *
+ *	The uptime clock is never moved backwards. If the new phase is earlier in the
+ *	millisecond than the old one the next tick is taken early instead.
+ *
+ *	Returns SC_INPUT_VALUE_RANGE_ERROR if no broadcast LF was received recently.
+ */
+uint8_t sys_sync(uint16_t phase_ms)
+{
+	uint8_t sreg = SREG;
+	cli();
+	uint32_t elapsed = sys_get_uptime_us() - device.sync_us;	// time since the LF
+	if (elapsed > SYNC_WINDOW_US) {
+		SREG = sreg;
+		return (SC_INPUT_VALUE_RANGE_ERROR);
+	}
+	uint8_t count = (uint8_t)((elapsed % 1000) / TICK_US_PER_COUNT);
+	if (count < TICK_TIMER) {
+		device.uptime_ms++;
+		if (device.tick_count != 0xFF) { device.tick_count++;}
+	}
+	TICK_TIMER = count;
+	uint16_t ms = (phase_ms + 1000 + (elapsed / 1000) - device.tick_count) % 1000;	// sync clock at the last serviced tick
+	SREG = sreg;
+
+	device.tick_10ms_count = 10 - (ms % 10);
+	ms += device.tick_10ms_count;					// sync clock at the next 10ms callout
+	device.tick_100ms_count = ((100 - (ms % 100)) % 100) / 10 + 1;
+	ms += (device.tick_100ms_count - 1) * 10;		// sync clock at the next 100ms callout
+	device.tick_1sec_count = ((1000 - (ms % 1000)) % 1000) / 100 + 1;
+	return (SC_OK);
 }
 
+/*
+ *	tick_callback() services all ticks that fired since the last call. If the main 
+ *	loop was busy for more than 1 ms the missed periods are caught up by advancing 
+ *	the down counters once per missed tick. Each callout runs at most once per pass
+ *	so a long stall doesn't cause a burst of back-to-back callouts; callouts that 
+ *	need elapsed time should read the uptime clock rather than count calls.
+ */
 uint8_t tick_callback(void)
 {
-	if (device.tick_flag == false) { return (SC_NOOP);}
+	uint8_t ticks;
+	uint8_t run_10ms = false;
+	uint8_t run_100ms = false;
+	uint8_t run_1sec = false;
+
+	cli();
+	ticks = device.tick_count;
+	device.tick_count = 0;
+	sei();
+	if (ticks == 0) { return (SC_NOOP);}
+	device.tick_overruns += (ticks - 1);
 
-	device.tick_flag = false;
 	tick_1ms();
 
-	if (--device.tick_10ms_count != 0) { return (SC_OK);}
-	device.tick_10ms_count = 10;
-	tick_10ms();
-
-	if (--device.tick_100ms_count != 0) { return (SC_OK);}
-	device.tick_100ms_count = 10;
-	tick_100ms();
+	while (ticks-- != 0) {
+		if (--device.tick_10ms_count != 0) { continue;}
+		device.tick_10ms_count = 10;
+		run_10ms = true;
 
-	if (--device.tick_1sec_count != 0) { return (SC_OK);}
-	device.tick_1sec_count = 10;
-	tick_1sec();
+		if (--device.tick_100ms_count != 0) { continue;}
+		device.tick_100ms_count = 10;
+		run_100ms = true;
 
+		if (--device.tick_1sec_count != 0) { continue;}
+		device.tick_1sec_count = 10;
+		run_1sec = true;
+	}
+	if (run_10ms == true) { tick_10ms();}
+	if (run_100ms == true) { tick_100ms();}
+	if (run_1sec == true) { tick_1sec();}
 	return (SC_OK);
 }
 
 void tick_1ms(void)				// 1ms callout
 {
+	uint8_t code = sensor.code;
+	PRF_BEGIN
 	sensor_callback();
+	PRF_END(PRF_SENSOR)
+	if (sensor.code != code) { device.epoch++;}	// a reading was posted (or failed)
 }
 
 void tick_10ms(void)			// 10 ms callout
@@ -212,11 +464,18 @@ void tick_10ms(void)			// 10 ms callout
 
 void tick_100ms(void)			// 100ms callout
 {
+	device.epoch++;					// starts a new epoch for cached group responses
+	heater_restore();				// first call only - once the cutoff threshold has settled
+	PRF_BEGIN
 	heater_callback();
+	PRF_END(PRF_HEATER)
+	al_callback();					// alarms see this pass's heater values
 }
 
 void tick_1sec(void)			// 1 second callout
 {
+	device.idle_percent = (uint8_t)((device.idle_counts * 100) / TICK_COUNTS_PER_SEC);
+	device.idle_counts = 0;
 //	led_toggle();
 }
 
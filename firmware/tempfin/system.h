@@ -54,8 +54,12 @@
 #define PWM_F_MIN			(F_CPU / PWM_PRESCALE / 256)
 #define PWM_FREQUENCY 		1000			// set PWM operating frequency
 
-#define PWM2_PORT			PORTD			// secondary PWM channel (on Timer 0)
+#define PWM_OUTB_COM		0x30			// OC2B compare output mode bits (TCCR2A)
+
+#define PWM2_PORT			PORTD			// secondary PWM channel (on Timer 0) - cooling fan or Peltier
+#define PWM2_DDR			DDRD
 #define PWM2_OUT2B			(1<<PIND5)		// OC0B timer output bit
+#define PWM2_COM			0x20			// OC0B non-inverted mode (TCCR0A)
 
 #define ADC_PORT			PORTC			// Analog to digital converter channels
 #define ADC_CHANNEL 		0				// ADC channel 0 / single-ended in this application (write to ADMUX)
@@ -66,10 +70,30 @@
 #define ADC_PRECISION 		1024			// change this if you go to 8 bit precision
 #define ADC_VREF 			5.00			// change this if the circuit changes. 3v would be about optimal
 
+//#define __AC_CUTOFF						// hardware overtemperature cutoff (needs AIN0 and AIN1 wired - see ac_init())
+#define AC_DAC_DDR			DDRB			// comparator threshold DAC: OC1A PWM through an RC filter into AIN0 (PD6)
+#define AC_DAC_OUT			(1<<PINB1)		// OC1A timer output bit
+#define AC_INPUTS_bm		((1<<AIN1D)|(1<<AIN0D))	// digital input disable bits for AIN0 and AIN1 (DIDR1)
+#define AC_MARGIN			5				// hardware cutoff is this far above the software overheat temperature
+
+#define TIMER1_MODE_A		(1<<WGM11)		// fast PWM mode 14 with TOP in ICR1 (TCCR1A value)...
+#define TIMER1_MODE_B		((1<<WGM13)|(1<<WGM12)|(1<<CS10))	// ...continued here, no prescaling (TCCR1B value)
+#define TIMER1_TOP			0xFFFF			// counts like normal mode so the profiler's cycle counts still work
+
 #define TICK_TIMER			TCNT0			// Tickclock timer
-#define TICK_MODE			0x02			// CTC mode 		(TCCR0A value)
-#define TICK_PRESCALER		0x03			// 64x prescaler  (TCCR0B value)
-#define TICK_COUNT			125				// gets 8 Mhz/64 to 1000 Hz.
+#define TICK_MODE			0x03			// fast PWM mode 7 - counts 0 to OCR0A like CTC (TCCR0A value)
+#define TICK_PRESCALER		0x0B			// mode 7 continued, 64x prescaler (TCCR0B value)
+#define TICK_PRESCALE		64				// corresponds to TICK_PRESCALER
+#define TICK_COUNT			((F_CPU / TICK_PRESCALE / 1000) - 1)	// CTC TOP for 1000 Hz (counts 0 to TOP)
+#define TICK_US_PER_COUNT	(TICK_PRESCALE / (F_CPU / 1000000UL))	// microseconds per tick timer count
+#define TICK_COUNTS_PER_SEC	((uint32_t)(TICK_COUNT+1) * 1000)	// tick timer counts in 1000 ticks
+
+#define SYNC_WINDOW_US		20000			// a sync must execute this soon after its broadcast LF
+
+#define STACK_CANARY		0xC5			// paint value for unused RAM (stack high-water measurement)
+
+#define WDT_TIMEOUT			WDTO_250MS		// watchdog period - a _controller() pass must finish well inside this
+#define RESET_WARM_bm		((1<<WDRF)|(1<<BORF))	// reset causes that may restore the previous heater state
 
 #define LED_PORT			PORTD			// LED port
 #define LED_PIN				(1<<PIND2)		// LED indicator
@@ -79,11 +103,19 @@
  ******************************************************************************/
 
 typedef struct DeviceStruct {	// hardware devices that are part of the chip
-	uint8_t tick_flag;			// true = the timer interrupt fired
+	volatile uint8_t tick_count;// ticks fired but not yet serviced (set by ISR)
+	volatile uint32_t uptime_ms;// monotonic millisecond clock (set by ISR)
+	uint32_t tick_overruns;		// count of ticks serviced late (caught up)
 	uint8_t tick_10ms_count;	// 10ms down counter
 	uint8_t tick_100ms_count;	// 100ms down counter
 	uint8_t tick_1sec_count;	// 1 second down counter
+	uint32_t epoch;				// bumped whenever tick driven values may have changed (never wraps in practice)
+	uint8_t idle_percent;		// percent of the last second spent sleeping
+	uint32_t idle_counts;		// tick timer counts spent sleeping in the current second
+	volatile uint32_t sync_us;	// uptime (us) at the LF of the last broadcast line
 	double pwm_freq;			// save it for stopping and starting PWM
+	volatile uint8_t ac_tripped;// analog comparator cut the heater (set by ISR)
+	uint8_t reset_flags;		// MCUSR at the last reset (see sys_save_reset_flags())
 } device_t;
 device_t device;				// Device is always a singleton (there is only one device)
 
@@ -92,6 +124,9 @@ device_t device;				// Device is always a singleton (there is only one device)
  ******************************************************************************/
 
 void sys_init(void);					// master hardware init
+void sys_paint_stack(void);				// paint unused RAM - call first thing in main()
+uint16_t sys_get_free_stack(void);		// minimum free stack since reset (bytes)
+uint16_t sys_get_free_ram(void);		// free RAM between heap and stack right now (bytes)
 
 void adc_init(uint8_t channel);
 uint16_t adc_read(void);
@@ -101,8 +136,23 @@ void pwm_on(double freq, double duty);
 void pwm_off(void);
 uint8_t pwm_set_freq(double freq);
 uint8_t pwm_set_duty(double duty);
+void pwm2_init(void);
+uint8_t pwm2_set_duty(double duty);
+
+#ifdef __AC_CUTOFF
+void ac_init(void);
+void ac_set_threshold(double temperature);
+uint8_t ac_arm(void);
+#else
+#define ac_init()
+#define ac_set_threshold(t)
+#define ac_arm() true
+#endif
 
 void tick_init(void);
+uint32_t sys_get_uptime_ms(void);
+uint32_t sys_get_uptime_us(void);
+uint8_t sys_sync(uint16_t phase_ms);
 uint8_t tick_callback(void);
 void tick_1ms(void);
 void tick_10ms(void);
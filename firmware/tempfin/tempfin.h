@@ -24,6 +24,7 @@
 /****** DEVELOPMENT SETTINGS ******/
 
 #define __CANNED_STARTUP					// run any canned startup commands
+#define __IDLE_SLEEP						// sleep the CPU when the main loop is idle (comment out for debugWIRE)
 //#define __DISABLE_PERSISTENCE				// disable EEPROM writes for faster simulation
 //#define __SUPPRESS_STARTUP_MESSAGES 		// what it says
 
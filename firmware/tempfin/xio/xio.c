@@ -69,9 +69,14 @@
  */
 
 #include <stdbool.h>
+#include <string.h>					// for memset, memcpy
 #include <stdio.h>					// precursor for xio.h
 #include <avr/pgmspace.h>			// precursor for xio.h
+#include <avr/interrupt.h>
+#include "../kinen.h"				// for __KINEN_MASTER
 #include "xio.h"					// all device sub-system includes are nested here
+#include <util/delay.h>				// must follow F_CPU in system.h (via xio.h)
+#include "../print.h"
 
 /***********************************************************************************
  * PUBLIC ENTRY POINTS - access functions via the XIO_DEV device number
@@ -79,11 +84,15 @@
  * xio_gets() 		- non-blocking get line function
  * xio_getc() 		- getc (not stdio compatible)
  * xio_putc() 		- putc (not stdio compatible)
+ * xio_rx_ready()	- true if the device has RX characters waiting
+ * xio_line_ready() - true if the device has a line for gets() (see below)
  * xio_ctrl() 		- set control flags (top-level XIO_DEV access)
  * xio_set_baud() 	- set baud rate (currently this only works on USART devices)
  * xio_set_stdin()  - set stdin from device number
  * xio_set_stdout() - set stdout from device number
  * xio_set_stderr() - set stderr from device number
+ * xio_get_stats()	- atomic copy of a device's statistics
+ * xio_reset_stats() - clear a device's statistics and ring high-water marks
  *
  * It might be prudent to run an assertion like below, but we trust the callers:
  * 	if (dev < XIO_DEV_COUNT) blah blah blah
@@ -93,12 +102,77 @@ FILE *xio_open(uint8_t dev, const char *addr, flags_t flags) { return (ds[dev]->
 int xio_gets(const uint8_t dev, char *buf, const int size) { return (ds[dev]->x_gets(ds[dev], buf, size));}
 int xio_getc(const uint8_t dev) { return (ds[dev]->x_getc(&(ds[dev]->stream)));}
 int xio_putc(const uint8_t dev, const char c) { return (ds[dev]->x_putc(c, &(ds[dev]->stream)));}
+int xio_rx_ready(const uint8_t dev) { return ((ds[dev]->rx->wr != ds[dev]->rx->rd) ? true : false);}
+
+buffer_t xio_tx_queued(const uint8_t dev)
+{
+	xioDev_t *d = ds[dev];
+	buffer_t queued = xio_buffer_used(d->tx);
+	if (d->txp != NULL) { queued += xio_buffer_used(d->txp);}
+	return (queued);
+}
+
+uint8_t xio_get_dev(FILE *stream)
+{
+	return (((xioDev_t *)stream->udata)->dev);
+}
+
+buffer_t xio_tx_room(FILE *stream)
+{
+	xioBuf_t *b = ((xioDev_t *)stream->udata)->tx;
+	return ((b->size - 1) - xio_buffer_used(b));
+}
+
+/*
+ *	xio_set_priority() selects the TX lane for the writes that follow. Set it 
+ *	around a complete message, including its LF, then clear it again.
+ */
+void xio_set_priority(FILE *stream, const uint8_t priority)
+{
+	((xioDev_t *)stream->udata)->flag_priority = priority;
+}
+
+/*
+ *	xio_line_ready() is true when the RX ISR has counted an LF into the buffer, so 
+ *	gets() will return a whole line without spinning on a partial one. It's also 
+ *	true when the buffer is more than half full. A line longer than the buffer 
+ *	could otherwise never complete, as its LF would be dropped.
+ */
+int xio_line_ready(const uint8_t dev)
+{
+	xioDev_t *d = ds[dev];
+	if (d->rx_lines != 0) { return (true);}
+	return ((xio_buffer_used(d->rx) > (d->rx->size >> 1)) ? true : false);
+}
 int xio_ctrl(const uint8_t dev, const flags_t flags) { return (xio_ctrl_device(ds[dev], flags));}
+#ifdef __XIO_RS485
+int xio_set_baud(const uint8_t dev, const uint8_t baud) { xio_set_baud_rs485(ds[dev], baud); return (XIO_OK);}
+#else
 int xio_set_baud(const uint8_t dev, const uint8_t baud) { xio_set_baud_usart(ds[dev], baud); return (XIO_OK);}
+#endif
 void xio_set_stdin(const uint8_t dev)  { stdin  = &(ds[dev]->stream);}
 void xio_set_stdout(const uint8_t dev) { stdout = &(ds[dev]->stream);}
 void xio_set_stderr(const uint8_t dev) { stderr = &(ds[dev]->stream);}
 
+void xio_get_stats(const uint8_t dev, xioStats_t *stats)
+{
+	uint8_t sreg = SREG;
+	cli();
+	memcpy(stats, &ds[dev]->stats, sizeof(xioStats_t));
+	SREG = sreg;
+}
+
+void xio_reset_stats(const uint8_t dev)
+{
+	uint8_t sreg = SREG;
+	cli();
+	memset(&ds[dev]->stats, 0, sizeof(xioStats_t));
+	if (ds[dev]->rx != NULL) { ds[dev]->rx->hwm = 0;}
+	if (ds[dev]->tx != NULL) { ds[dev]->tx->hwm = 0;}
+	if (ds[dev]->txp != NULL) { ds[dev]->txp->hwm = 0;}
+	SREG = sreg;
+}
+
 /***********************************************************************************
  * xio_init() 			- initialize entire xio sub-system
  * xio_reset_device()	- common function used by opens()
@@ -108,18 +182,32 @@ void xio_set_stderr(const uint8_t dev) { stderr = &(ds[dev]->stream);}
 void xio_init()
 {
 	// run device constructors and register devices in dev array
+#ifdef __XIO_RS485
+	ds[XIO_DEV_USART] = xio_init_rs485(XIO_DEV_USART);	// the RS-485 port takes the USART's place
+#else
 	ds[XIO_DEV_USART] = xio_init_usart(XIO_DEV_USART);
+#endif
 	ds[XIO_DEV_SPI]   = xio_init_spi(XIO_DEV_SPI);
 //	ds[XIO_DEV_PGM]   = xio_init_file(XIO_DEV_PGM);
 
 	// open individual devices (file device opens occur at time-of-use)
+#ifdef __XIO_RS485
+	xio_open(XIO_DEV_USART, NULL, RS485_XIO_FLAGS);
+#else
 	xio_open(XIO_DEV_USART, NULL, USART_XIO_FLAGS);
+#endif
+#ifndef __KINEN_MASTER						// a master drives the SPI hardware from kinen.c
 	xio_open(XIO_DEV_SPI, NULL, SPI_XIO_FLAGS);
+#endif
 
 	// setup std devices for printf/fprintf to work
 	xio_set_stdin(XIO_DEV_USART);
 	xio_set_stdout(XIO_DEV_USART);
+#if defined(__KINEN_MASTER) || defined(__XIO_RS485)
+	xio_set_stderr(XIO_DEV_USART);			// responses go to the host or back on the RS-485 bus
+#else
 	xio_set_stderr(XIO_DEV_SPI);
+#endif
 }
 
 void xio_reset_device(xioDev_t *d,  const flags_t flags)
@@ -132,9 +220,18 @@ void xio_reset_device(xioDev_t *d,  const flags_t flags)
 		d->tx->wr = 1;
 		d->tx->rd = 1;
 	}
+	if (d->txp != NULL) {
+		d->txp->wr = 1;
+		d->txp->rd = 1;
+	}
+	d->tx_lane = XIO_LANE_NONE;
+	d->txp_wait = XIO_TX_WAIT_US;
+	d->flag_priority = 0;
 	d->flag_in_line = 0;			// reset the working flags
+	d->rx_lines = 0;
 	d->flag_eol = 0;
 	d->flag_eof = 0;
+	d->flag_discard = 0;
 
 	xio_ctrl_device(d, flags);		// setup control flags
 
@@ -182,7 +279,12 @@ int xio_getc_device(FILE *stream)
 
 int xio_putc_device(const char c, FILE *stream)
 {
-	return (xio_write_buffer(((xioDev_t *)stream->udata)->tx, c));
+	xioDev_t *d = (xioDev_t *)stream->udata;
+	if (xio_write_tx(d, c) == _FDEV_ERR) {
+		d->stats.tx_drops++;
+		return (_FDEV_ERR);
+	}
+	return (XIO_OK);
 }
 
 /* 
@@ -197,11 +299,22 @@ int xio_putc_device(const char c, FILE *stream)
  *
  *	  - Encounters an empty buffer. Leave in_line. Return XIO_EAGAIN.
  *
- *	  - A successful read would cause output buffer overflow. Return XIO_BUFFER_FULL
+ *	  - A successful read would cause output buffer overflow. Terminate the buffer
+ *		and return XIO_BUFFER_FULL (once). The rest of the line is read and thrown 
+ *		away up to and including the newline, so the next call starts a fresh line.
  *
  *	Note: LINEMODE flag in device struct is ignored. It's ALWAYS LINEMODE here.
  *	Note: CRs are not recognized as NL chars - master must send LF to terminate a line
+ *	Note: each LF read takes back one count from the RX ISR's line count
  */
+static void _take_line(xioDev_t *d)
+{
+	uint8_t sreg = SREG;
+	cli();
+	if (d->rx_lines != 0) { d->rx_lines--;}
+	SREG = sreg;
+}
+
 int xio_gets_device(xioDev_t *d, char *buf, const int size)
 {
 	int c_out;
@@ -215,11 +328,24 @@ int xio_gets_device(xioDev_t *d, char *buf, const int size)
 	}
 	while (true) {
 		if (d->len >= (d->size)-1) {			// size is total count - aka 'num' in fgets()
-			d->buf[d->size] = NUL;				// string termination preserves latest char
+			d->buf[(d->size)-1] = NUL;			// terminate within the buffer
+			d->flag_discard = true;				// throw away the rest of the line
+			d->len = 0;
+			d->stats.line_too_long++;
 			return (XIO_BUFFER_FULL);
 		}
 		if ((c_out = xio_read_buffer(d->rx)) == _FDEV_ERR) { return (XIO_EAGAIN);}
+		if (d->flag_discard == true) {
+			if (c_out == LF) {
+				_take_line(d);
+				d->flag_discard = false;
+				d->flag_in_line = false;		// start a fresh line on the next call
+				return (XIO_EAGAIN);
+			}
+			continue;
+		}
 		if (c_out == LF) {
+			_take_line(d);
 //			d->buf[(d->len)++] = LF;			// ++++++++++++++++ for diagnostics only
 			d->buf[(d->len)++] = NUL;
 			d->flag_in_line = false;			// clear in-line state (reset)
@@ -245,6 +371,11 @@ int8_t xio_read_buffer(xioBuf_t *b)
 	return (b->buf[b->rd]);						// return character from buffer
 }												// leave rd on *returned* char
 
+buffer_t xio_buffer_used(xioBuf_t *b)
+{
+	return ((b->rd >= b->wr) ? (b->rd - b->wr) : (b->rd + b->size - b->wr));
+}
+
 //int xio_write_buffer(xioBuf_t *b, char c) 
 int8_t xio_write_buffer(xioBuf_t *b, char c) 
 {
@@ -253,18 +384,65 @@ int8_t xio_write_buffer(xioBuf_t *b, char c)
 	if (next_wr == b->rd) { return (_FDEV_ERR);}// return if queue full
 	b->buf[next_wr] = c;						// write char to buffer
 	b->wr = next_wr;							// advance wr from temp value
+
+	buffer_t used = xio_buffer_used(b);
+	if (used > b->hwm) { b->hwm = used;}		// track peak occupancy
 	return (XIO_OK);							// leave wr on *written* char
 }
 
+/*
+ * TX lane primitives (see "TX lanes" in xio.h)
+ *
+ *	xio_write_tx() - write a char to the lane selected by flag_priority
+ *	xio_read_tx()  - get the next char to send. Called from the TX ISRs
+ *
+ *	The device putc() starts its TX interrupt (or data ready) after every write, 
+ *	so a full priority lane is always being drained while a write waits on it.
+ */
+int8_t xio_write_tx(xioDev_t *d, const char c)
+{
+	xioBuf_t *b = ((d->flag_priority == true) && (d->txp != NULL)) ? d->txp : d->tx;
+
+	if (b == d->txp) {							// wait for the ISR to make room
+		while ((xio_buffer_used(b) >= (b->size - 2)) && (d->txp_wait != 0)) {
+			if ((SREG & (1<<SREG_I)) == 0) { break;}
+			_delay_us(1);
+			d->txp_wait--;
+		}
+		if (c == LF) { d->txp_wait = XIO_TX_WAIT_US;}	// next message gets a fresh allowance
+	}
+	if ((c != LF) && (xio_buffer_used(b) >= (b->size - 2))) { return (_FDEV_ERR);}	// keep room for the LF
+	return (xio_write_buffer(b, c));
+}
+
+int8_t xio_read_tx(xioDev_t *d)
+{
+	if (d->tx_lane == XIO_LANE_NONE) {			// between lines - choose a lane
+		if ((d->txp != NULL) && (d->txp->wr != d->txp->rd)) { d->tx_lane = XIO_LANE_PRIORITY;}
+		else if (d->tx->wr != d->tx->rd) { d->tx_lane = XIO_LANE_NORMAL;}
+		else { return (_FDEV_ERR);}
+	}
+	int8_t c = xio_read_buffer((d->tx_lane == XIO_LANE_PRIORITY) ? d->txp : d->tx);
+	if (c == LF) { d->tx_lane = XIO_LANE_NONE;}
+	return (c);								// _FDEV_ERR if the lane ran dry mid-line
+}
+
 /*
  *	xio_queue_RX_string() - put a string in an RX buffer
  *	String must be NUL terminated but doesn't require a CR or LF
+ *	LFs are counted as the RX ISR would, with interrupts held off for each char
  */
 void xio_queue_RX_string(const uint8_t dev, const char *buf)
 {
 	uint8_t i=0;
 	while (buf[i] != NUL) {
-		xio_write_buffer(ds[dev]->rx, buf[i++]);
+		uint8_t sreg = SREG;
+		cli();
+		if ((xio_write_buffer(ds[dev]->rx, buf[i]) == XIO_OK) && (buf[i] == LF)) {
+			ds[dev]->rx_lines++;
+		}
+		SREG = sreg;
+		i++;
 	}
 }
 
@@ -277,6 +455,7 @@ static void _transmit_test(uint8_t dev);
 //static void _loopback_test(uint8_t dev);
 //static void _loopfake_test(uint8_t dev);
 static void _message_test(uint8_t dev);
+static void _priority_test(uint8_t dev);
 //static void _pgm_read_test();
 
 int c;
@@ -291,6 +470,7 @@ void xio_unit_tests()
 //	_loopfake_test(XIO_DEV_USART);			// never returns
 
 //	_loopback_test(XIO_DEV_SPI);			// never returns
+//	_priority_test(XIO_DEV_USART);			// never returns
 	_message_test(XIO_DEV_SPI);				// never returns
 }
 
@@ -308,11 +488,37 @@ static void _transmit_test(uint8_t dev)		// never returns
 	}
 }
 
+/*
+ * _priority_test() - a full group read goes through the priority lane whole
+ *
+ *	The response is longer than any priority lane, and a report is queued in 
+ *	the normal lane ahead of it. The response must come out whole, right after 
+ *	the report. A line saying how many chars were dropped follows each pair.
+ */
+static void _priority_test(uint8_t dev)		// never returns
+{
+	FILE *stream = &ds[dev]->stream;
+
+	while (true) {
+		uint16_t drops = ds[dev]->stats.tx_drops;
+		print_str_P(stream, PSTR("{\"sr\":{\"tmp\":123.456,\"set\":120.000}}\n"));
+		xio_set_priority(stream, true);
+		print_str_P(stream, PSTR("{\"r\":{\"h1\":{\"st\":3,\"tmp\":123.456,\"set\":120.000,\"hys\":5,"
+								 "\"amb\":40.000,\"ovr\":10.000,\"ato\":90.000,\"reg\":10.000,"
+								 "\"rto\":300.000,\"bad\":5}}}\n"));
+		xio_set_priority(stream, false);
+		print_ftoa(buffer, ds[dev]->stats.tx_drops - drops, 0);
+		print_str(stream, buffer);
+		print_str_P(stream, PSTR(" dropped\n"));
+		_delay_ms(500);
+	}
+}
+
 static void _message_test(uint8_t dev)		// never returns
 {
 	while (true) {
 		if ((status = xio_gets(dev, buffer, sizeof(buffer))) == XIO_OK) {
-			printf("%s",buffer);
+			print_str(stdout, buffer);
 		}
 	}
 }
@@ -64,6 +64,29 @@
  *
  *	See xio_read_buffer() and xio_read_buffer() for functionality
  */
+/* --- TX lanes ---
+ *
+ *	A device may have a second, high priority TX buffer (txp) next to the normal 
+ *	one. Writes go to the priority lane while flag_priority is set (see 
+ *	xio_set_priority()), so responses, alarms and shutdown messages don't queue 
+ *	up behind a long report.
+ *
+ *	The TX ISR takes its characters from xio_read_tx(). It only changes lanes 
+ *	at a message boundary - after it has sent an LF - so lines are never mixed. 
+ *	At a boundary it takes the priority lane if that holds anything and the 
+ *	normal lane otherwise. So a priority message starts going out as soon as its 
+ *	first char is written, and the lane only has to hold part of it.
+ *
+ *	A priority write that finds its lane full waits for the ISR to make room, so 
+ *	a response longer than the lane arrives whole. A message may spend at most 
+ *	XIO_TX_WAIT_US waiting in all (nothing moves on SPI until the master clocks 
+ *	it out), which keeps a stalled lane well inside the watchdog period. After 
+ *	that the rest of the message is cut. It never waits with interrupts off. 
+ *
+ *	Normal writes don't wait. Both lanes keep their last free location for the 
+ *	LF, so a line that doesn't fit is cut short but still ends. Without that a 
+ *	lane could be left in the middle of a line and hold the other lane off.
+ */
 /* --- What's the the int characters? ---
  *	Single characters returned from buffer queues are treated as ints in order to 
  *	ease compatibility with stdio. This ia a bit of a pain but is necessary to 
@@ -92,6 +115,8 @@
 // Pre-allocated XIO devices (configured devices)
 // Unused devices are commented out. All this needs to line up.
 
+//#define __XIO_RS485				// run the USART as an RS-485 multi-drop port (xio_rs485.c)
+
 enum xioDev {			// TYPE:	DEVICE:
 	XIO_DEV_USART = 0,	// USART	USART device
 	XIO_DEV_SPI,		// SPI		SPI device
@@ -112,6 +137,8 @@ enum xioDev {			// TYPE:	DEVICE:
  *
  ******************************************************************************/
 
+#define XIO_TX_WAIT_US	50000				// most a priority message can wait for lane room (us)
+
 #define flags_t uint16_t
 #define buffer_t uint8_t					// fast, but limits buffer to 255 char max
 
@@ -119,9 +146,20 @@ typedef struct xioBuffer {
 	buffer_t size;							// buffer size -1 (for wrapping)
 	volatile buffer_t rd;					// read index
 	volatile buffer_t wr;					// write index
+	buffer_t hwm;							// high-water mark (peak occupancy)
 	char buf[];								// array size set by device RX/TX definitions
 } xioBuf_t;
 
+typedef struct xioStatistics {				// per-device counters (see xio_reset_stats())
+	uint32_t rx_bytes;						// characters written into the RX buffer
+	uint32_t tx_bytes;						// characters taken from the TX buffer and sent
+	uint16_t rx_drops;						// RX characters lost to a full RX buffer
+	uint16_t tx_drops;						// TX characters lost to a full TX buffer
+	uint16_t rx_overruns;					// hardware receive overruns (USART DOR)
+	uint16_t line_too_long;					// lines discarded by gets() as too long
+	uint32_t etx_count;						// ETXs sent because TX was empty (SPI slave)
+} xioStats_t;
+
 typedef struct xioDEVICE {					// common device struct (one per dev)
 	uint8_t dev;							// self referential device number
 	FILE *(*x_open)(const uint8_t dev, const char *addr, const flags_t flags);
@@ -133,6 +171,7 @@ typedef struct xioDEVICE {					// common device struct (one per dev)
 	void (*x_flow)(struct xioDEVICE *d);	// flow control callback function
 	xioBuf_t *rx;							// RX buffer struct binding
 	xioBuf_t *tx;							// TX buffer struct binding
+	xioBuf_t *txp;							// priority TX buffer binding (NULL if none)
 	void *x;								// extended device struct binding
 	FILE stream;							// stdio stream structure
 
@@ -143,13 +182,26 @@ typedef struct xioDEVICE {					// common device struct (one per dev)
 	uint8_t flag_in_line;					// used as a state variable for line reads
 	uint8_t flag_eol;						// end of line (message) detected
 	uint8_t flag_eof;						// end of file detected
+	uint8_t flag_discard;					// discarding the rest of an over-long line
+	volatile uint8_t rx_lines;				// LFs in the RX buffer (counted by the RX ISR)
+	uint8_t flag_priority;					// writes go to the priority TX lane
+	volatile uint8_t tx_lane;				// lane the TX ISR is sending a line from (see xioLane)
+	uint16_t txp_wait;						// us the priority message being written may still wait
 
 	// gets() working data
 	int size;								// text buffer length (dynamic)
 	uint8_t len;							// chars read so far (buf array index)
 	char *buf;								// text buffer binding (can be dynamic)	
+
+	xioStats_t stats;						// device statistics (written from ISRs)
 } xioDev_t;
 
+enum xioLane {								// TX lanes
+	XIO_LANE_NONE = 0,						// at a message boundary - next line may come from either
+	XIO_LANE_NORMAL,
+	XIO_LANE_PRIORITY
+};
+
 typedef FILE *(*x_open_t)(const uint8_t dev, const char *addr, const flags_t flags);
 typedef int (*x_close_t)(xioDev_t *d);
 typedef int (*x_ctrl_t)(xioDev_t *d, const flags_t flags);
@@ -164,6 +216,7 @@ typedef void (*x_flow_t)(xioDev_t *d);
 // all sub-includes here so only xio.h is needed externally
 #include "xio_spi.h"
 #include "xio_usart.h"
+#include "xio_rs485.h"
 #include "xio_file.h"
 
 xioDev_t *ds[XIO_DEV_COUNT];			// array of device structure pointers 
@@ -179,6 +232,14 @@ int xio_ctrl(const uint8_t dev, const flags_t flags);
 int xio_gets(const uint8_t dev, char *buf, const int size);
 int xio_getc(const uint8_t dev);
 int xio_putc(const uint8_t dev, const char c);
+int xio_rx_ready(const uint8_t dev);
+int xio_line_ready(const uint8_t dev);
+buffer_t xio_tx_queued(const uint8_t dev);		// characters waiting in the TX buffers
+uint8_t xio_get_dev(FILE *stream);				// device number behind a stream
+void xio_set_priority(FILE *stream, const uint8_t priority);
+buffer_t xio_tx_room(FILE *stream);				// free space in the normal TX lane
+void xio_get_stats(const uint8_t dev, xioStats_t *stats);
+void xio_reset_stats(const uint8_t dev);
 int xio_set_baud(const uint8_t dev, const uint8_t baud_rate);
 void xio_set_stdin(const uint8_t dev);
 void xio_set_stdout(const uint8_t dev);
@@ -198,6 +259,9 @@ int xio_gets_device(xioDev_t *d, char *buf, const int size);
 //int xio_write_buffer(xioBuf_t *b, char c);
 int8_t xio_read_buffer(xioBuf_t *b);
 int8_t xio_write_buffer(xioBuf_t *b, char c);
+buffer_t xio_buffer_used(xioBuf_t *b);
+int8_t xio_write_tx(xioDev_t *d, const char c);
+int8_t xio_read_tx(xioDev_t *d);
 void xio_queue_RX_string(const uint8_t dev, const char *buf);
 
 /*************************************************************************
@@ -271,6 +335,7 @@ enum xioCodes {
 #define CR	(char)0x0D		// ^m - carriage return
 #define XON (char)0x11		// ^q - DC1, XON, resume
 #define XOFF (char)0x13		// ^s - DC3, XOFF, pause
+#define SYN (char)0x16		// ^v - SYN, Kinen broadcast line prefix
 #define NAK (char)0x15		// ^u - Negative acknowledgement
 #define CAN (char)0x18		// ^x - Cancel, abort
 #define ESC (char)0x1B		// ^[ - ESC(ape)
@@ -36,6 +36,7 @@ xioDev_t file0 = {
 		xio_null,
 		(xioBuf_t *)NULL,		// file IO is not buffered
 		(xioBuf_t *)NULL,
+		(xioBuf_t *)NULL,
 		(xioFile_t *)&file_x0	// unnecessary to initialize the rest of the struct 
 };
 
@@ -0,0 +1,203 @@
+/*
+ * xio_rs485.c	- RS-485 half-duplex multi-drop device driver for the atmega328p
+ * 				- works with avr-gcc stdio library
+ * Part of Kinen project
+ *
+ * Copyright (c) 2010 - 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The RS-485 driver is a half duplex driver that works over a single A/B
+ * differential pair shared by the master and all the fins on the cable.
+ * A node may only drive the bus while it's answering the master. Most of
+ * the specialized logic here deals with that constraint. It's a port of
+ * the xmega driver in extras/xio_rs485.c.
+ *
+ * Protocol:
+ *
+ *	- Each message from the master starts with an address byte: the node
+ *		address (1 - 127) with the high bit set. Message text is 7 bit ASCII so
+ *		an address byte can't be mistaken for text. A node keeps the characters
+ *		that follow its own address and ignores everything else.
+ *
+ *	- Address 0 is a broadcast to all nodes. The RX ISR puts a SYN in front of
+ *		the line so it's executed without a response (see json_parser.c), and 
+ *		stamps device.sync_us at its LF, as the SPI ISR does, for {"sync":N}.
+ *
+ *	- The addressed node sends its response as soon as it's ready. The master
+ *		must not send again until it has the response LF plus one bit time.
+ *
+ * Turnaround:
+ *
+ *	DE and /RE are tied together on one pin. putc() raises DE before the first
+ *	character is loaded. When the TX buffer runs dry the UDRE interrupt hands
+ *	over to the transmit complete (TXC) interrupt, which fires as the last stop
+ *	bit leaves the shift register and releases the bus right then. There is no
+ *	polling and no fixed guard delay, so turnaround is the TXC interrupt latency.
+ */
+#include <stdio.h>					// precursor for xio.h
+#include <stdbool.h>				// true and false
+#include <avr/interrupt.h>
+#include "xio.h"					// nested includes for all devices and types
+#include "../system.h"
+#include "../profiler.h"
+
+#ifdef __XIO_RS485
+
+// allocate and initialize RS485 structs (same buffers as the USART)
+xioUsartRX_t rs485_rx = { USART_RX_BUFFER_SIZE-1,1,1 };
+xioUsartTX_t rs485_tx = { USART_TX_BUFFER_SIZE-1,1,1 };
+xioUsartTXP_t rs485_txp = { USART_TXP_BUFFER_SIZE-1,1,1 };
+xioDev_t rs485 = {
+		XIO_DEV_USART,
+		xio_open_rs485,
+		xio_ctrl_device,
+		xio_gets_device,
+		xio_getc_rs485,
+		xio_putc_rs485,
+		xio_null,
+		(xioBuf_t *)&rs485_rx,
+		(xioBuf_t *)&rs485_tx,
+		(xioBuf_t *)&rs485_txp,		// unnecessary to initialize the rest of the struct
+};
+
+// Fast accessors
+#define RS485rx rs485.rx			// these compile to static references
+#define RS485tx rs485.tx
+
+/*
+ *	xio_init_rs485() - RS485 initialization
+ *					   requires open() to be performed to complete the device init
+ */
+xioDev_t *xio_init_rs485(uint8_t dev)
+{
+	rs485.dev = dev;	// overwite the structure initialization value in case it was wrong
+	rsx.addr = RS485_ADDRESS;
+	rsx.selected = false;
+	rsx.broadcast = false;
+	return (&rs485);
+}
+
+/*
+ *	xio_open_rs485() - RS485 open
+ *	open() assumes that init() has been run previously
+ */
+FILE *xio_open_rs485(const uint8_t dev, const char *addr, const flags_t flags)
+{
+	xioDev_t *d = ds[dev];			// convenience device struct pointer
+	xio_reset_device(d, flags);
+
+	// setup the hardware - start out listening
+	RS485_DE_PORT &= ~RS485_DE_bm;
+	RS485_DE_DDR |= RS485_DE_bm;
+	PORTD |= RS485_RXD_bm;
+	PRR &= ~PRUSART0_bm;			// Enable the USART in the power reduction register (system.h)
+	UCSR0A = RS485_UCSR0A;
+	UCSR0B = RS485_ENABLE_FLAGS;
+	xio_set_baud_rs485(d, RS485_BAUD_RATE);
+
+	return (&d->stream);			// return stdio FILE reference
+}
+
+void xio_set_baud_rs485(xioDev_t *d, const uint32_t baud)
+{
+	UBRR0 = (F_CPU / (8 * baud)) - 1;	// this is the doubler's formula
+}
+
+/*
+ * xio_putc_rs485() - stdio compatible char writer for RS485 devices
+ * USART UDRE ISR() - load the next character or hand over to TXC
+ * USART TXC ISR()	- last character is out; release the bus
+ *
+ *	DE must be up and TXCIE off before the UDRE interrupt can load a character,
+ *	or the first start bit goes out on a dead driver or TXC drops the bus early.
+ *	So both are done with interrupts off.
+ */
+int xio_putc_rs485(const char c, FILE *stream)
+{
+	xioDev_t *d = (xioDev_t *)stream->udata;
+	int status = xio_write_tx(d, c);
+	if (status == _FDEV_ERR) { d->stats.tx_drops++;}
+
+	uint8_t sreg = SREG;
+	cli();
+	RS485_DE_PORT |= RS485_DE_bm;						// take the bus (already ours if sending)
+	UCSR0B = (UCSR0B & ~(1<<TXCIE0)) | (1<<UDRIE0);
+	SREG = sreg;
+	return (status);
+}
+
+ISR(USART_UDRE_vect)
+{
+	PRF_BEGIN
+	int c = xio_read_tx(&rs485);
+	if (c == _FDEV_ERR) {
+		UCSR0B = (UCSR0B & ~(1<<UDRIE0)) | (1<<TXCIE0);	// release the bus when the shift register empties
+	} else {
+		UCSR0A = RS485_UCSR0A | (1<<TXC0);				// clear a stale TXC from the last message
+		UDR0 = (char)c;
+		rs485.stats.tx_bytes++;
+		LAT_TX_SENT(rs485.dev)
+	}
+	PRF_END(PRF_USART_TX)
+}
+
+ISR(USART_TX_vect)
+{
+	RS485_DE_PORT &= ~RS485_DE_bm;
+	UCSR0B &= ~(1<<TXCIE0);
+}
+
+/*
+ *  USART RX ISR()		- keep characters addressed to this node
+ *  xio_getc_rs485() 	- char reader for RS485 devices
+ *
+ *	The RX ISR runs for every character on the bus, so it does as little as
+ *	possible for frames addressed to other nodes. There is no echo and no flow
+ *	control on a shared bus.
+ */
+ISR(USART_RX_vect)
+{
+	PRF_BEGIN
+	if (UCSR0A & (1<<DOR0)) { rs485.stats.rx_overruns++;}	// must be read before UDR0
+	uint8_t c = UDR0;
+	if (c & RS485_ADDRESS_FLAG) {							// address byte starts a new frame
+		c &= ~RS485_ADDRESS_FLAG;
+		rsx.selected = ((c == rsx.addr) || (c == RS485_BROADCAST));
+		rsx.broadcast = (c == RS485_BROADCAST);
+		c = (c == RS485_BROADCAST) ? SYN : NUL;				// mark broadcast lines
+	}
+	if ((rsx.selected == true) && (c != NUL)) {
+		if (xio_write_buffer(RS485rx, c) == _FDEV_ERR) {
+			rs485.stats.rx_drops++;
+		} else {
+			rs485.stats.rx_bytes++;
+			if (c == LF) {
+				if (rsx.broadcast == true) {				// time base for {"sync":N} (see sys_sync())
+					device.sync_us = sys_get_uptime_us();
+					rsx.broadcast = false;
+				}
+				rs485.rx_lines++;
+				LAT_RX_LF(rs485.dev)
+			}
+		}
+	}
+	PRF_END(PRF_USART_RX)
+}
+
+int xio_getc_rs485(FILE *stream)
+{
+	xioDev_t *d = (xioDev_t *)stream->udata;		// get device struct pointer
+	int c = xio_read_buffer(d->rx);
+	if ((c == CR) || (c == LF)) { if (d->flag_linemode) { return('\n');}}
+	return (c);
+}
+
+#endif // __XIO_RS485
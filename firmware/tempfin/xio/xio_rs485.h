@@ -0,0 +1,58 @@
+/*
+ * xio_rs485.h - RS-485 half-duplex multi-drop device for the atmega328p USART
+ * Part of Kinen project
+ *
+ * Copyright (c) 2012 - 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY 
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef xio_rs485_h
+#define xio_rs485_h
+
+/******************************************************************************
+ * RS485 DEVICE CONFIGS AND STRUCTURES
+ *
+ * The RS-485 device takes the USART's place in the device table when
+ * __XIO_RS485 is defined in xio.h. It uses the USART buffer structs.
+ ******************************************************************************/
+
+#define RS485_BAUD_RATE		250000								// exact at 16 MHz with the doubler on
+#define RS485_UCSR0A		(1<<U2X0)							// baud doubler on; also written when clearing TXC
+#define RS485_ENABLE_FLAGS	(1<<RXCIE0 | 1<<TXEN0 | 1<<RXEN0)	// enable recv interrupt, TX and RX
+#define RS485_XIO_FLAGS 	(XIO_BLOCK | XIO_NOECHO | XIO_LINEMODE)	// never echo on a shared bus
+
+#define RS485_DE_PORT		PORTD			// driver enable and receiver enable (DE and /RE tied)
+#define RS485_DE_DDR		DDRD
+#define RS485_DE_bm			(1<<PORTD4)		// high = drive the bus, low = listen
+#define RS485_RXD_bm		(1<<PORTD0)		// pulled up so RXD idles while /RE is high
+
+#define RS485_ADDRESS_FLAG	0x80			// high bit marks an address byte - text is 7 bit ASCII
+#define RS485_BROADCAST		0				// address all nodes. Broadcasts get no response
+#define RS485_ADDRESS		1				// default node address
+#define RS485_ADDRESS_MAX	127
+
+typedef struct xioRs485 {					// RS-485 extended device data
+	uint8_t addr;							// this node's address (1 - RS485_ADDRESS_MAX)
+	volatile uint8_t selected;				// the current frame is for this node (or broadcast)
+	volatile uint8_t broadcast;				// the current frame is a broadcast (stamps sync_us at its LF)
+} xioRs485_t;
+xioRs485_t rsx;
+
+/******************************************************************************
+ * RS485 CLASS AND DEVICE FUNCTION PROTOTYPES AND ALIASES
+ ******************************************************************************/
+
+xioDev_t *xio_init_rs485(uint8_t dev);
+FILE *xio_open_rs485(const uint8_t dev, const char *addr, const flags_t flags);
+void xio_set_baud_rs485(xioDev_t *d, const uint32_t baud);
+int xio_getc_rs485(FILE *stream);
+int xio_putc_rs485(const char c, FILE *stream);
+
+#endif
@@ -48,6 +48,13 @@
  *		the char (or message) being received from the master and transmitted from the
  *		slave. It's just IO.
  *
+ *	- A master broadcasts a line to all slaves by first sending a SYN (0x16) to 
+ *		each slave, then selecting all slaves at once and sending the line. On SYN
+ *		the slave releases MISO so the slaves don't fight over it, and keeps the 
+ *		SYN as the first char of the line to mark it as a broadcast. Broadcasts are
+ *		executed without a response. MISO is driven again after the line's LF, and
+ *		the time of the LF is stamped for sys_sync().
+ *
  *		If the slave has no data to send it should return ETX (0x03) on MISO. This is 
  *		useful to distinghuish between an "empty" slave and a non-responsive SPI slave or
  *		unpopulated Kinen socket - which would return NULs or possibly 0xFFs.
@@ -56,27 +63,40 @@
  *		the slave. The slave discards all STXs and simply returns output data on these
  *		transfers. Presumably the master would stop polling once it receives an ETX 
  *		from the slave.
+ *
+ *	- Data ready (optional). The slave pulls its DRDY line low once a complete
+ *		message is in its TX buffers and lets go when it returns ETX. A priority
+ *		message (a response) pulls it low from its first char, as it's sent while 
+ *		it's still being written and may be longer than its TX lane. The line is
+ *		open drain, so the DRDY lines of all the fins can be wired together with
+ *		one pull-up. The master only needs to poll while that line is low.
  */
 #include <stdio.h>					// precursor for xio.h
 #include <stdbool.h>				// true and false
 #include <avr/interrupt.h>
 #include "xio.h"					// nested includes for all devices and types
+#include "../system.h"
+#include "../profiler.h"
 
 // allocate and initialize SPI structs
 xioSpiRX_t spi0_rx = { SPI_RX_BUFFER_SIZE-1,1,1 };
 xioSpiTX_t spi0_tx = { SPI_TX_BUFFER_SIZE-1,1,1 };
+xioSpiTXP_t spi0_txp = { SPI_TXP_BUFFER_SIZE-1,1,1 };
 xioDev_t spi0 = {
 		XIO_DEV_SPI,
 		xio_open_spi,
 		xio_ctrl_device,				// use device generic function
 		xio_gets_device,				// " "
 		xio_getc_device,				// " "
-		xio_putc_device,				// " "
+		xio_putc_spi,
 		xio_null,
 		(xioBuf_t *)&spi0_rx,
-		(xioBuf_t *)&spi0_tx,			// unecessary to initialize from here on...
+		(xioBuf_t *)&spi0_tx,
+		(xioBuf_t *)&spi0_txp,			// unecessary to initialize from here on...
 };
 
+static volatile uint8_t spi_broadcast;	// receiving a broadcast line - MISO is released
+
 // Fast accessors
 //#define SPIrx ds[XIO_DEV_SPI]->rx		// these compile to static references
 //#define SPItx ds[XIO_DEV_SPI]->tx
@@ -105,13 +125,41 @@ FILE *xio_open_spi(const uint8_t dev, const char *addr, const flags_t flags)
 	PRR &= ~PRSPI_bm;				// Enable SPI in power reduction register (system.h)
 	SPCR |= SPI_MODE;
 	DDRB |= SPI_OUTBITS;
+	SPI_DRDY_PORT &= ~SPI_DRDY_bm;	// data ready is open drain - the port bit stays low
+	SPI_DRDY_RELEASE;
 
 	return (&d->stream);			// return stdio FILE reference
 }
 
+/*
+ * xio_set_drdy_spi() - enable or disable the data ready line (released when disabled)
+ * xio_putc_spi()	  - write a char to the TX buffers. Assert data ready at the end of a 
+ *						message, or at any char of a priority message
+ *
+ *	DRDY is set and cleared with single sbi/cbi instructions, so it's safe 
+ *	against the SPI ISR changing the other DDRB bits.
+ */
+void xio_set_drdy_spi(const uint8_t drdy)
+{
+	spx.drdy = drdy;
+	if ((drdy == true) && (xio_tx_queued(spi0.dev) != 0)) {
+		SPI_DRDY_ASSERT;
+	} else {
+		SPI_DRDY_RELEASE;
+	}
+}
+
+int xio_putc_spi(const char c, FILE *stream)
+{
+	int status = xio_putc_device(c, stream);
+	if (((c == LF) || (spi0.flag_priority == true)) && (status == XIO_OK) && (spx.drdy == true)) {
+		SPI_DRDY_ASSERT;
+	}
+	return (status);
+}
+
 /*
  * xio_getc_spi() - read char from the RX buffer. Return error if no character available
- * xio_putc_spi() - Write a character into the TX buffer for MISO piggyback transmission
  * SPI Slave Interrupt() - interrupts on RX byte received
  */
  /*
@@ -120,17 +168,46 @@ int xio_getc_spi(FILE *stream)
 	return (xio_read_buffer(((xioDev_t *)stream->udata)->rx));
 }
 
-int xio_putc_spi(const char c, FILE *stream)
-{
-	return (xio_write_buffer(((xioDev_t *)stream->udata)->tx, c));
-}
 */
 ISR(SPI_STC_vect)
 {
+	PRF_BEGIN
 	char c = SPDR;								// read the incoming character; save it
-	int c_out = xio_read_buffer(SPI0tx); 		// stage the next char to transmit on MISO from the TX buffer
-	if (c_out ==_FDEV_ERR) SPDR = ETX; else SPDR = (char)c_out;	// stage next TX char or ETX if none	
-	xio_write_buffer(SPI0rx, c);				// write incoming char into RX buffer
+	if (c == SYN) {								// a broadcast line follows
+		DDRB &= ~SPI_OUTBITS;
+		spi_broadcast = true;
+	}
+	if (spi_broadcast == true) {				// MISO is released - don't consume TX chars
+		if (c == LF) {
+			device.sync_us = sys_get_uptime_us();
+			DDRB |= SPI_OUTBITS;
+			spi_broadcast = false;
+		}
+		SPDR = ETX;
+	} else {
+		int c_out = xio_read_tx(&spi0); 		// stage the next char to transmit on MISO from the TX lanes
+		if (c_out ==_FDEV_ERR) {				// stage next TX char or ETX if none
+			SPDR = ETX;
+			spi0.stats.etx_count++;
+			SPI_DRDY_RELEASE;
+		} else {
+			SPDR = (char)c_out;
+			spi0.stats.tx_bytes++;
+			LAT_TX_SENT(spi0.dev)
+		}
+	}
+	if ((c != STX) && (c != NUL)) {				// discard master polls and fill
+		if (xio_write_buffer(SPI0rx, c) == _FDEV_ERR) {	// write incoming char into RX buffer
+			spi0.stats.rx_drops++;
+		} else {
+			spi0.stats.rx_bytes++;
+			if (c == LF) {
+				spi0.rx_lines++;
+				LAT_RX_LF(spi0.dev)
+			}
+		}
+	}
+	PRF_END(PRF_SPI)
 
 //	char c = SPDR;									// read the incoming character; save it
 //	if (SPI0rx->head == SPI0rx->tail) { SPDR = NAK;}	// RX buffer is full. - send NAK to master
@@ -26,14 +26,23 @@
 #define SPI_OUTBITS		(1<<DDB4)			// Set SCK, MOSI, SS to input, MISO to output
 #define SPI_XIO_FLAGS 	(XIO_LINEMODE)
 
+#define SPI_DRDY_PORT	PORTB				// data ready output - open drain, active low
+#define SPI_DRDY_DDR	DDRB
+#define SPI_DRDY_bm		(1<<PORTB0)
+#define SPI_DRDY		true				// default for the data ready line (sys.drdy)
+#define SPI_DRDY_ASSERT	(SPI_DRDY_DDR |= SPI_DRDY_bm)	// drive the line low
+#define SPI_DRDY_RELEASE (SPI_DRDY_DDR &= ~SPI_DRDY_bm)	// let the pull-up have it
+
 // Buffer structs must be the same as xioBuf, except that the buf array size is defined.
 #define SPI_RX_BUFFER_SIZE 64
-#define SPI_TX_BUFFER_SIZE 64
+#define SPI_TX_BUFFER_SIZE 32
+#define SPI_TXP_BUFFER_SIZE 64				// priority TX lane - carries the command responses
 
 typedef struct xioSpiRX {
 	buffer_t size;							// initialize to SPI_RX_BUFFER_SIZE-1
 	volatile buffer_t rd;					// read index
 	volatile buffer_t wr;					// write index
+	buffer_t hwm;						// high-water mark (peak occupancy)
 	char buf[SPI_RX_BUFFER_SIZE];
 } xioSpiRX_t;
 
@@ -41,17 +50,32 @@ typedef struct xioSpiTX {
 	buffer_t size;
 	volatile buffer_t rd;
 	volatile buffer_t wr;
+	buffer_t hwm;
 	char buf[SPI_TX_BUFFER_SIZE];
 } xioSpiTX_t;
 
+typedef struct xioSpiTXP {
+	buffer_t size;
+	volatile buffer_t rd;
+	volatile buffer_t wr;
+	buffer_t hwm;
+	char buf[SPI_TXP_BUFFER_SIZE];
+} xioSpiTXP_t;
+
+typedef struct xioSpi {						// SPI extended device data
+	uint8_t drdy;							// data ready line is enabled
+} xioSpi_t;
+xioSpi_t spx;
+
 /******************************************************************************
  * SPI FUNCTION PROTOTYPES AND ALIASES
  ******************************************************************************/
 
 xioDev_t *xio_init_spi(uint8_t dev);
 FILE *xio_open_spi(const uint8_t dev, const char *addr, const flags_t flags);
+void xio_set_drdy_spi(const uint8_t drdy);
+int xio_putc_spi(const char c, FILE *stream);
 //int xio_gets_spi(xioDev_t *d, char *buf, const int size);
 //int xio_getc_spi(FILE *stream);
-//int xio_putc_spi(const char c, FILE *stream);
 
 #endif // xio_spi_h
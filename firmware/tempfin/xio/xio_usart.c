@@ -17,10 +17,14 @@
 #include <stdbool.h>				// true and false
 #include <avr/interrupt.h>
 #include "xio.h"					// nested includes for all devices and types
+#include "../profiler.h"
+
+#ifndef __XIO_RS485					// the RS-485 device owns the USART (xio_rs485.c)
 
 // allocate and initialize USART structs
 xioUsartRX_t usart0_rx = { USART_RX_BUFFER_SIZE-1,1,1 };
 xioUsartTX_t usart0_tx = { USART_TX_BUFFER_SIZE-1,1,1 };
+xioUsartTXP_t usart0_txp = { USART_TXP_BUFFER_SIZE-1,1,1 };
 xioDev_t usart0 = {
 		XIO_DEV_USART,
 		xio_open_usart,
@@ -30,7 +34,8 @@ xioDev_t usart0 = {
 		xio_putc_usart,
 		xio_null,
 		(xioBuf_t *)&usart0_rx,
-		(xioBuf_t *)&usart0_tx,		// unnecessary to initialize the rest of the struct 
+		(xioBuf_t *)&usart0_tx,
+		(xioBuf_t *)&usart0_txp,	// unnecessary to initialize the rest of the struct 
 };
 
 // Fast accessors
@@ -83,19 +88,25 @@ void xio_set_baud_usart(xioDev_t *d, const uint32_t baud)
  */
 int xio_putc_usart(const char c, FILE *stream)
 {
-	int status = xio_write_buffer(((xioDev_t *)stream->udata)->tx, c);
+	xioDev_t *d = (xioDev_t *)stream->udata;
+	int status = xio_write_tx(d, c);
+	if (status == _FDEV_ERR) { d->stats.tx_drops++;}
 	UCSR0B |= (1<<UDRIE0); 		// enable TX interrupts - they will keep firing
 	return (status);
 }
 
 ISR(USART_UDRE_vect)
 {
-	int c = xio_read_buffer(USART0tx);
+	PRF_BEGIN
+	int c = xio_read_tx(&usart0);
 	if (c == _FDEV_ERR) {
-		UCSR0B &= ~(1<<UDRIE0); // disable interrupts
+		UCSR0B &= ~(1<<UDRIE0); // disable interrupts (putc turns them back on)
 	} else {
 		UDR0 = (char)c;			// write char to USART xmit register
+		usart0.stats.tx_bytes++;
+		LAT_TX_SENT(usart0.dev)
 	}
+	PRF_END(PRF_USART_TX)
 }
 
 /*
@@ -117,7 +128,19 @@ ISR(USART_UDRE_vect)
  */
 ISR(USART_RX_vect) 
 { 
-	xio_write_buffer(USART0rx, UDR0);
+	PRF_BEGIN
+	if (UCSR0A & (1<<DOR0)) { usart0.stats.rx_overruns++;}	// must be read before UDR0
+	char c = UDR0;
+	if (xio_write_buffer(USART0rx, c) == _FDEV_ERR) {
+		usart0.stats.rx_drops++;
+	} else {
+		usart0.stats.rx_bytes++;
+		if (c == LF) {
+			usart0.rx_lines++;
+			LAT_RX_LF(usart0.dev)
+		}
+	}
+	PRF_END(PRF_USART_RX)
 }
 
 int xio_getc_usart(FILE *stream)
@@ -143,3 +166,5 @@ int xio_getc_usart(FILE *stream)
 	return (c);
 */
 }
+
+#endif // __XIO_RS485
@@ -28,11 +28,13 @@
 // Buffer structs must be the same as xioBuf except that the buf array size is defined.
 #define USART_RX_BUFFER_SIZE 32
 #define USART_TX_BUFFER_SIZE 32
+#define USART_TXP_BUFFER_SIZE 32			// priority TX lane - holds a shutdown message or an alarm
 
 typedef struct xioUsartRX {
 	buffer_t size;						// initialize to USART_RX_BUFFER_SIZE-1
 	volatile buffer_t rd;				// read index
 	volatile buffer_t wr;				// write index
+	buffer_t hwm;					// high-water mark (peak occupancy)
 	char buf[USART_RX_BUFFER_SIZE];
 } xioUsartRX_t;
 
@@ -40,9 +42,18 @@ typedef struct xioUsartTX {
 	buffer_t size;						// initialize to USART_RX_BUFFER_SIZE-1
 	volatile buffer_t rd;				// read index
 	volatile buffer_t wr;				// write index (written by ISR)
+	buffer_t hwm;					// high-water mark (peak occupancy)
 	char buf[USART_TX_BUFFER_SIZE];
 } xioUsartTX_t;
 
+typedef struct xioUsartTXP {
+	buffer_t size;						// initialize to USART_TXP_BUFFER_SIZE-1
+	volatile buffer_t rd;				// read index
+	volatile buffer_t wr;				// write index
+	buffer_t hwm;					// high-water mark (peak occupancy)
+	char buf[USART_TXP_BUFFER_SIZE];
+} xioUsartTXP_t;
+
 /******************************************************************************
  * USART CLASS AND DEVICE FUNCTION PROTOTYPES AND ALIASES
  ******************************************************************************/
@@ -0,0 +1,374 @@
+/*
+ * fin_sim.c - simulated TempFin on a pseudo terminal, for testing host clients
+ * Part of Kinen project
+ *
+ * Copyright (c) 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*	Usage: fin-sim [-l LINK] [-d DELAY_US] [-b BAUD] [-r RING_BYTES]
+ *
+ *	Opens a pty, prints the slave's path (and symlinks it to LINK if given) and
+ *	answers JSON lines the way js_json_parser() does, with a subset of the
+ *	TempFin's tokens and a first order heater model behind h1tmp.
+ *
+ *	-d	time taken to process each line, in microseconds
+ *	-b	pace responses at this baud rate (10 bits per character). 0 is unpaced
+ *	-r	emulate the fin's RX ring: characters that arrive while this many are
+ *		waiting are dropped, as they would be on the real USART. 0 is unlimited
+ *
+ *	Stops on SIGINT or SIGTERM and prints what it received and dropped.
+ */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+
+#define SYN 0x16
+#define LINE_MAX_LEN 256
+#define RING_MAX 4096
+
+typedef struct simToken {
+	const char *group;					// "" for sys tokens
+	const char *token;
+	int integer;						// print as an integer
+	int writable;
+	double value;
+} simToken_t;
+
+static simToken_t table[] = {			// mirrors cfgArray in config_app.c
+	{ "sys", "fb",    0, 0, 7.03 },
+	{ "sys", "fv",    0, 0, 0.1 },
+	{ "sys", "hv",    0, 1, 0.1 },
+	{ "sys", "idle",  0, 0, 0 },
+	{ "sys", "upt",   1, 0, 0 },
+	{ "sys", "upms",  1, 0, 0 },
+	{ "sys", "tkov",  1, 0, 0 },
+	{ "sys", "sync",  1, 1, 0 },
+	{ "h1",  "st",    1, 0, 1 },
+	{ "h1",  "tmp",   0, 0, 25 },
+	{ "h1",  "set",   0, 1, 0 },
+	{ "h1",  "hys",   1, 1, 10 },
+	{ "h1",  "amb",   0, 1, 40 },
+	{ "h1",  "ovr",   0, 1, 300 },
+	{ "h1",  "ato",   0, 1, 90 },
+	{ "h1",  "reg",   0, 1, 3 },
+	{ "h1",  "rto",   0, 1, 300 },
+	{ "h1",  "bad",   1, 1, 5 },
+	{ "s1",  "st",    1, 0, 0 },
+	{ "s1",  "tmp",   0, 0, 25 },
+	{ "s1",  "svm",   0, 0, 0 },
+	{ "s1",  "rvm",   0, 0, 0 },
+	{ "p1",  "kp",    0, 1, 5 },
+	{ "p1",  "ki",    0, 1, 0.1 },
+	{ "p1",  "kd",    0, 1, 0.5 },
+	{ "p1",  "smx",   0, 1, 200 },
+	{ "p1",  "smn",   0, 1, -200 },
+};
+#define TABLE_LEN (sizeof(table)/sizeof(simToken_t))
+
+static volatile sig_atomic_t done = 0;
+static double start_s;
+static unsigned long lines, broadcasts, rx_bytes, rx_drops, unknown;
+
+static double _now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+static void _stop(int sig) { done = 1;}
+
+static simToken_t *_find(const char *group, const char *token)
+{
+	for (unsigned i=0; i<TABLE_LEN; i++) {
+		if ((strcmp(table[i].group, group) == 0) && (strcmp(table[i].token, token) == 0)) {
+			return (&table[i]);
+		}
+	}
+	return (NULL);
+}
+
+static int _is_group(const char *name)
+{
+	for (unsigned i=0; i<TABLE_LEN; i++) {
+		if (strcmp(table[i].group, name) == 0) return (1);
+	}
+	return (0);
+}
+
+/*
+ * _lookup() - resolve a flat token like "h1tmp" or "upt" the way cmd_get_index() does
+ */
+static simToken_t *_lookup(const char *name)
+{
+	for (unsigned i=0; i<TABLE_LEN; i++) {
+		const char *g = table[i].group;
+		size_t glen = (strcmp(g, "sys") == 0) ? 0 : strlen(g);
+		if ((strncmp(name, g, glen) == 0) && (strcmp(name + glen, table[i].token) == 0)) {
+			return (&table[i]);
+		}
+	}
+	return (NULL);
+}
+
+/*
+ * _model() - first order heater: heats toward the setpoint, cools toward 25C
+ */
+static void _model(void)
+{
+	static double last_s = 0;
+	double now = _now();
+	double dt = (last_s == 0) ? 0 : now - last_s;
+	last_s = now;
+
+	simToken_t *st = _find("h1", "st");
+	simToken_t *tmp = _find("h1", "tmp");
+	double target = (st->value == 2) ? _find("h1", "set")->value : 25;
+	tmp->value += (target - tmp->value) * (1 - exp(-dt / 5.0));
+	_find("s1", "tmp")->value = tmp->value;
+	double ms = floor((now - start_s) * 1000);
+	_find("sys", "upt")->value = floor(ms / 1000);
+	_find("sys", "upms")->value = fmod(ms, 1000);
+}
+
+static void _set(simToken_t *t, double value)
+{
+	t->value = value;
+	if ((strcmp(t->group, "h1") == 0) && (strcmp(t->token, "set") == 0)) {
+		_find("h1", "st")->value = (value > 0) ? 2 : 1;		// HEATER_HEATING : HEATER_OFF
+	}
+}
+
+static int _format(char *buf, size_t size, const char *name, simToken_t *t)
+{
+	return (snprintf(buf, size, t->integer ? "\"%s\":%1.0f" : "\"%s\":%0.3f", name, t->value));
+}
+
+/*
+ * _parse_pair() - read "name":value or "name":"" or "name":{ from a normalized line
+ *
+ *	Returns a pointer past the pair, or NULL on a syntax error. has_value is 0
+ *	for "" (a get), 1 for a number and 2 for an opening brace.
+ */
+static char *_parse_pair(char *s, char *name, double *value, int *has_value)
+{
+	if (*s++ != '"') return (NULL);
+	char *q = strchr(s, '"');
+	if ((q == NULL) || (q - s >= 32) || (q[1] != ':')) return (NULL);
+	memcpy(name, s, q - s);
+	name[q - s] = 0;
+	s = q + 2;
+	if (*s == '{') {
+		*has_value = 2;
+		return (s + 1);
+	}
+	if ((s[0] == '"') && (s[1] == '"')) {
+		*has_value = 0;
+		return (s + 2);
+	}
+	char *end;
+	*value = strtod(s, &end);
+	if (end == s) return (NULL);
+	*has_value = 1;
+	return (end);
+}
+
+/*
+ * _execute() - run one line and write the response into out. Returns its length
+ *
+ *	The response has the same shape as the firmware's: {"r":{...}} with one
+ *	member per object in the request, or {"r":{}} if anything went wrong.
+ */
+static int _execute(char *line, char *out, size_t size)
+{
+	char norm[LINE_MAX_LEN];
+	int n = 0;
+	for (char *p = line; *p && (n < LINE_MAX_LEN-1); p++) {	// _normalize_json_string()
+		if (!isspace((unsigned char)*p)) norm[n++] = tolower((unsigned char)*p);
+	}
+	norm[n] = 0;
+
+	int len = snprintf(out, size, "{\"r\":{");
+	char *s = norm;
+	char name[32], child[32];
+	double value;
+	int has_value;
+	int first = 1;
+
+	if (*s++ != '{') goto error;
+	while (*s != '}') {
+		if ((s = _parse_pair(s, name, &value, &has_value)) == NULL) goto error;
+		if (!first) len += snprintf(out + len, size - len, ",");
+		first = 0;
+
+		if (has_value == 0 && _is_group(name)) {			// group read
+			len += snprintf(out + len, size - len, "\"%s\":{", name);
+			int k = 0;
+			for (unsigned i=0; i<TABLE_LEN; i++) {
+				if (strcmp(table[i].group, name) != 0) continue;
+				if (k++ > 0) len += snprintf(out + len, size - len, ",");
+				len += _format(out + len, size - len, table[i].token, &table[i]);
+			}
+			len += snprintf(out + len, size - len, "}");
+		} else if (has_value == 2) {						// {"h1":{"set":150}}
+			if (!_is_group(name)) goto error;
+			len += snprintf(out + len, size - len, "\"%s\":{", name);
+			for (int k=0; *s != '}'; k++) {
+				if ((s = _parse_pair(s, child, &value, &has_value)) == NULL) goto error;
+				simToken_t *t = _find(name, child);
+				if ((t == NULL) || (has_value == 2)) goto error;
+				if (has_value == 1) {
+					if (!t->writable) goto error;
+					_set(t, value);
+				}
+				if (k > 0) len += snprintf(out + len, size - len, ",");
+				len += _format(out + len, size - len, child, t);
+				if (*s == ',') s++;
+			}
+			s++;
+			len += snprintf(out + len, size - len, "}");
+		} else {
+			simToken_t *t = _lookup(name);
+			if (t == NULL) goto error;
+			if (has_value == 1) {
+				if (!t->writable) goto error;
+				_set(t, value);
+			}
+			len += _format(out + len, size - len, name, t);
+		}
+		if (*s == ',') s++;
+	}
+	len += snprintf(out + len, size - len, "}}\n");
+	return (len);
+
+error:
+	unknown++;
+	return (snprintf(out, size, "{\"r\":{}}\n"));
+}
+
+int main(int argc, char *argv[])
+{
+	const char *link_path = NULL;
+	long delay_us = 0;
+	long baud = 0;
+	int ring_max = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:d:b:r:")) != -1) {
+		switch (opt) {
+			case 'l': link_path = optarg; break;
+			case 'd': delay_us = atol(optarg); break;
+			case 'b': baud = atol(optarg); break;
+			case 'r': ring_max = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: fin-sim [-l LINK] [-d DELAY_US] [-b BAUD] [-r RING_BYTES]\n");
+				return (2);
+		}
+	}
+	if ((ring_max <= 0) || (ring_max > RING_MAX)) ring_max = RING_MAX;
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0)) {
+		perror("posix_openpt");
+		return (1);
+	}
+	const char *slave_path = ptsname(master);
+	int slave = open(slave_path, O_RDWR | O_NOCTTY);	// held open so the master never sees a hangup
+	struct termios t;
+	tcgetattr(slave, &t);
+	cfmakeraw(&t);
+	tcsetattr(slave, TCSANOW, &t);
+
+	if (link_path != NULL) {
+		unlink(link_path);
+		if (symlink(slave_path, link_path) != 0) {
+			perror(link_path);
+			return (1);
+		}
+	}
+	printf("%s\n", slave_path);
+	fflush(stdout);
+
+	signal(SIGINT, _stop);
+	signal(SIGTERM, _stop);
+	start_s = _now();
+
+	char ring[RING_MAX];
+	int ring_len = 0;
+	double busy_until = 0;
+
+	while (!done) {
+		struct pollfd p = { master, POLLIN, 0 };
+		int wait_ms = 50;
+		if (memchr(ring, '\n', ring_len) != NULL) {
+			double left = busy_until - _now();
+			wait_ms = (left > 0) ? (int)(left * 1000) + 1 : 0;
+		}
+		if (poll(&p, 1, wait_ms) > 0) {
+			char buf[256];
+			ssize_t n = read(master, buf, sizeof(buf));
+			for (ssize_t i=0; i<n; i++) {
+				rx_bytes++;
+				if (ring_len < ring_max) {
+					ring[ring_len++] = buf[i];
+				} else {
+					rx_drops++;
+				}
+			}
+		}
+		// run one complete line once the previous one is finished
+		char *lf = memchr(ring, '\n', ring_len);
+		if ((lf == NULL) || (_now() < busy_until)) continue;
+
+		char line[LINE_MAX_LEN];
+		int llen = (int)(lf - ring);
+		if (llen >= LINE_MAX_LEN) llen = LINE_MAX_LEN-1;
+		memcpy(line, ring, llen);
+		line[llen] = 0;
+		ring_len -= (int)(lf - ring) + 1;
+		memmove(ring, lf + 1, ring_len);
+		if ((llen > 0) && (line[llen-1] == '\r')) line[--llen] = 0;
+		if (llen == 0) continue;
+
+		_model();
+		char out[LINE_MAX_LEN * 2];
+		int olen;
+		if (line[0] == SYN) {								// broadcast: execute silently
+			broadcasts++;
+			_execute(line + 1, out, sizeof(out));
+			olen = 0;
+		} else {
+			lines++;
+			olen = _execute(line, out, sizeof(out));
+		}
+		busy_until = _now() + delay_us * 1e-6;
+		if (olen > 0) {
+			if (baud > 0) busy_until += olen * 10.0 / baud;	// the fin can't parse while it prints
+			if (write(master, out, olen) != olen) break;
+		}
+	}
+	fprintf(stderr, "fin-sim: %lu lines, %lu broadcasts, %lu errors, %lu bytes received, %lu dropped\n",
+			lines, broadcasts, unknown, rx_bytes, rx_drops);
+	if (link_path != NULL) unlink(link_path);
+	close(slave);
+	close(master);
+	return (0);
+}
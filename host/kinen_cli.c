@@ -0,0 +1,130 @@
+/*
+ * kinen_cli.c - command line front end for the Kinen host client
+ * Part of Kinen project
+ *
+ * Copyright (c) 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*	Usage: kinen-cli -d DEVICE [-b BAUD] [-w WINDOW] [-t TIMEOUT_MS] [-q] COMMAND...
+ *
+ *	Commands run in order. Everything is pipelined, so "get h1tmp get s1tmp" sends
+ *	both requests before the first answer comes back.
+ *
+ *		get TOKEN			read a token or a group		get h1tmp	get h1
+ *		set TOKEN VALUE		set a token					set h1set 150
+ *		send JSON			send a raw line				send '{"h1set":150}'
+ *		bcast JSON			broadcast (no response)		bcast '{"sync":0}'
+ *		bench TOKEN N		read TOKEN N times and print statistics
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "kinen_client.h"
+
+static int quiet = 0;
+
+static void _print_response(const kclResponse_t *r, void *context)
+{
+	static const char *msg[] = { "ok", "empty", "timeout", "lost" };
+	int *failed = (int *)context;
+
+	if ((r->status == KCL_TIMEOUT) || (r->status == KCL_LOST)) (*failed)++;
+	if (quiet) return;
+	if (r->line != NULL) {
+		printf("%s\n", r->line);
+	} else {
+		fprintf(stderr, "#%u %s: %s\n", r->tag, msg[r->status], r->request);
+	}
+}
+
+static void _usage(void)
+{
+	fprintf(stderr,
+		"usage: kinen-cli -d DEVICE [-b BAUD] [-w WINDOW] [-t TIMEOUT_MS] [-q] COMMAND...\n"
+		"  get TOKEN | set TOKEN VALUE | send JSON | bcast JSON | bench TOKEN N\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *device = NULL;
+	int baud = 115200;
+	int window = KCL_WINDOW_BYTES;
+	int timeout = KCL_TIMEOUT_MS;
+	int failed = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:b:w:t:q")) != -1) {
+		switch (opt) {
+			case 'd': device = optarg; break;
+			case 'b': baud = atoi(optarg); break;
+			case 'w': window = atoi(optarg); break;
+			case 't': timeout = atoi(optarg); break;
+			case 'q': quiet = 1; break;
+			default: _usage();
+		}
+	}
+	if ((device == NULL) || (optind >= argc)) _usage();
+
+	kclClient_t *c = kcl_open(device, baud);
+	if (c == NULL) {
+		perror(device);
+		return (1);
+	}
+	kcl_set_callback(c, _print_response, &failed);
+	kcl_set_window(c, window);
+	kcl_set_timeout(c, timeout);
+
+	uint32_t tag = 0;
+	int bench = 0;
+	for (int i=optind; i<argc; i++) {
+		const char *cmd = argv[i];
+		int status;
+		if ((strcmp(cmd, "get") == 0) && (i+1 < argc)) {
+			status = kcl_get(c, argv[++i], tag++);
+		} else if ((strcmp(cmd, "set") == 0) && (i+2 < argc)) {
+			status = kcl_set(c, argv[i+1], strtod(argv[i+2], NULL), tag++);
+			i += 2;
+		} else if ((strcmp(cmd, "send") == 0) && (i+1 < argc)) {
+			status = kcl_send(c, argv[++i], tag++);
+		} else if ((strcmp(cmd, "bcast") == 0) && (i+1 < argc)) {
+			status = kcl_broadcast(c, argv[++i]);
+		} else if ((strcmp(cmd, "bench") == 0) && (i+2 < argc)) {
+			const char *token = argv[i+1];
+			int n = atoi(argv[i+2]);
+			i += 2;
+			bench = 1;
+			quiet = 1;
+			kcl_reset_stats(c);
+			status = 0;
+			for (int k=0; (k<n) && (status == 0); k++) {
+				while (kcl_outstanding(c) >= KCL_QUEUE_MAX) {
+					if (kcl_poll(c, 10) < 0) break;
+				}
+				status = kcl_get(c, token, tag++);
+			}
+		} else {
+			_usage();
+		}
+		if (status != 0) {
+			fprintf(stderr, "%s: request failed\n", cmd);
+			failed++;
+		}
+	}
+	if (kcl_drain(c, timeout + 1000) != 0) {
+		fprintf(stderr, "%d requests unanswered\n", kcl_outstanding(c));
+		failed++;
+	}
+	if (bench) kcl_print_stats(c, stdout);
+	kcl_close(c);
+	return (failed ? 1 : 0);
+}
@@ -0,0 +1,438 @@
+/*
+ * kinen_client.c - host side client for Kinen fins (JSON lines over a tty or pty)
+ * Part of Kinen project
+ *
+ * Copyright (c) 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "kinen_client.h"
+
+#define SYN (char)0x16					// broadcast line prefix (see xio.h)
+#define KEY_MAX 32
+
+typedef struct kclRequest {
+	char line[KCL_LINE_MAX];			// request as sent, including LF
+	char key[KEY_MAX];					// first key, lowercased. Empty for broadcasts
+	int len;
+	uint32_t tag;
+	double sent_s;						// time the last byte was written
+} kclRequest_t;
+
+struct kclClient {
+	int fd;
+	int window;							// max request bytes in flight
+	double timeout_s;
+	kcl_callback_t callback;
+	void *context;
+
+	kclRequest_t q[KCL_QUEUE_MAX];		// circular. Oldest first; the first 'inflight' are written
+	int head;
+	int count;
+	int inflight;
+	int inflight_bytes;
+
+	char rx[KCL_LINE_MAX];				// response line being assembled
+	int rx_len;
+	kclStats_t stats;
+};
+
+static double _now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+static speed_t _speed(int baud)
+{
+	switch (baud) {
+		case 9600:	 return (B9600);
+		case 19200:	 return (B19200);
+		case 38400:	 return (B38400);
+		case 57600:	 return (B57600);
+		case 115200: return (B115200);
+		case 230400: return (B230400);
+#ifdef B250000
+		case 250000: return (B250000);
+#endif
+		default:	 return (B115200);
+	}
+}
+
+/*
+ * _first_key() - copy the first JSON key in a line, lowercased
+ *
+ *	The fin lowercases and strips whitespace before parsing, so keys are
+ *	compared the same way here.
+ */
+static void _first_key(const char *s, char *key)
+{
+	int i = 0;
+	if ((s = strchr(s, '"')) != NULL) {
+		for (s++; (*s != '"') && (*s != 0) && (i < KEY_MAX-1); s++) {
+			if (!isspace((unsigned char)*s)) { key[i++] = tolower((unsigned char)*s);}
+		}
+	}
+	key[i] = 0;
+}
+
+/*
+ * kcl_open() - open a fin's port in raw mode and return a client (NULL on error)
+ * kcl_close()
+ */
+kclClient_t *kcl_open(const char *path, int baud)
+{
+	kclClient_t *c = calloc(1, sizeof(kclClient_t));
+	if (c == NULL) return (NULL);
+
+	if ((c->fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0) {
+		free(c);
+		return (NULL);
+	}
+	struct termios t;
+	if (tcgetattr(c->fd, &t) == 0) {	// fails harmlessly on things that aren't ttys
+		cfmakeraw(&t);
+		t.c_cflag |= CLOCAL | CREAD;
+		t.c_cflag &= ~CRTSCTS;
+		cfsetispeed(&t, _speed(baud));
+		cfsetospeed(&t, _speed(baud));
+		tcsetattr(c->fd, TCSANOW, &t);
+		tcflush(c->fd, TCIOFLUSH);
+	}
+	c->window = KCL_WINDOW_BYTES;
+	c->timeout_s = KCL_TIMEOUT_MS / 1000.0;
+	kcl_reset_stats(c);
+	return (c);
+}
+
+void kcl_close(kclClient_t *c)
+{
+	if (c == NULL) return;
+	close(c->fd);
+	free(c);
+}
+
+void kcl_set_callback(kclClient_t *c, kcl_callback_t callback, void *context)
+{
+	c->callback = callback;
+	c->context = context;
+}
+
+void kcl_set_window(kclClient_t *c, int bytes) { c->window = bytes;}
+void kcl_set_timeout(kclClient_t *c, int ms) { c->timeout_s = ms / 1000.0;}
+int kcl_outstanding(kclClient_t *c) { return (c->count);}
+
+/*
+ * _write_all() - write a whole request, waiting for the port if it's full
+ */
+static int _write_all(kclClient_t *c, const char *buf, int len)
+{
+	while (len > 0) {
+		ssize_t n = write(c->fd, buf, len);
+		if (n < 0) {
+			if ((errno != EAGAIN) && (errno != EINTR)) return (-1);
+			struct pollfd p = { c->fd, POLLOUT, 0 };
+			poll(&p, 1, 100);
+			continue;
+		}
+		buf += n;
+		len -= n;
+		c->stats.tx_bytes += n;
+	}
+	return (0);
+}
+
+/*
+ * _transmit() - write queued requests while they fit in the window
+ *
+ *	A request is always written if nothing is in flight, so a line longer than
+ *	the window still goes out (one at a time). Broadcasts get no response, so
+ *	they're written and retired at once, but only when the fin has answered
+ *	everything before them - otherwise they could overrun its RX ring.
+ */
+static int _transmit(kclClient_t *c)
+{
+	while (c->inflight < c->count) {
+		kclRequest_t *r = &c->q[(c->head + c->inflight) % KCL_QUEUE_MAX];
+		int broadcast = (r->key[0] == 0);
+		if (c->inflight > 0) {
+			if (broadcast || (c->inflight_bytes + r->len > c->window)) break;
+		}
+		if (_write_all(c, r->line, r->len) != 0) return (-1);
+		r->sent_s = _now();
+		if (broadcast) {
+			c->stats.broadcasts++;
+			c->head = (c->head + 1) % KCL_QUEUE_MAX;
+			c->count--;
+			continue;
+		}
+		if (c->stats.requests++ == 0) { c->stats.start_s = r->sent_s;}
+		c->inflight++;
+		c->inflight_bytes += r->len;
+	}
+	return (0);
+}
+
+/*
+ * _retire() - remove the oldest in-flight request and report it to the callback
+ */
+static void _retire(kclClient_t *c, uint8_t status, const char *line, double now)
+{
+	kclRequest_t *r = &c->q[c->head];
+	kclResponse_t resp = { r->tag, status, 0, r->line, line };
+
+	if ((status == KCL_OK) || (status == KCL_EMPTY)) {
+		double us = (now - r->sent_s) * 1e6;
+		kclStats_t *s = &c->stats;
+		resp.latency_us = us;
+		s->responses++;
+		if (status == KCL_EMPTY) s->empty++;
+		if (us < s->latency_min_us) s->latency_min_us = us;
+		if (us > s->latency_max_us) s->latency_max_us = us;
+		s->latency_sum_us += us;
+		int bin = (us < 1) ? 0 : (int)log2(us);
+		s->hist[(bin < KCL_HIST_BINS) ? bin : KCL_HIST_BINS-1]++;
+		s->last_s = now;
+	} else if (status == KCL_TIMEOUT) {
+		c->stats.timeouts++;
+	} else {
+		c->stats.lost++;
+	}
+	r->line[r->len-1] = 0;				// drop the LF for the callback
+	if (c->callback != NULL) c->callback(&resp, c->context);
+
+	c->head = (c->head + 1) % KCL_QUEUE_MAX;
+	c->count--;
+	c->inflight--;
+	c->inflight_bytes -= r->len;
+}
+
+/*
+ * _match() - match one response line to the in-flight requests
+ *
+ *	An empty response ({"r":{}}) has no key to check, so it goes to the oldest.
+ */
+static int _match(kclClient_t *c, const char *line, double now)
+{
+	static const char prefix[] = "{\"r\":{";
+	if (strncmp(line, prefix, sizeof(prefix)-1) != 0) {
+		c->stats.unsolicited++;
+		return (0);
+	}
+	const char *body = line + sizeof(prefix)-1;
+	if ((*body == '}') && (c->inflight > 0)) {
+		_retire(c, KCL_EMPTY, line, now);
+		return (1);
+	}
+	char key[KEY_MAX];
+	_first_key(body, key);
+	for (int i=0; i<c->inflight; i++) {
+		if (strcmp(c->q[(c->head + i) % KCL_QUEUE_MAX].key, key) == 0) {
+			while (i-- > 0) { _retire(c, KCL_LOST, NULL, now);}
+			_retire(c, KCL_OK, line, now);
+			return (1);
+		}
+	}
+	c->stats.unsolicited++;
+	return (0);
+}
+
+/*
+ * kcl_poll() - service the port for up to timeout_ms
+ *
+ *	Writes whatever the window allows, reads responses and matches them, and
+ *	times out the oldest request if it's been waiting too long. Returns as soon
+ *	as something was delivered, or after the timeout.
+ */
+int kcl_poll(kclClient_t *c, int timeout_ms)
+{
+	int delivered = 0;
+	if (_transmit(c) != 0) return (-1);
+
+	struct pollfd p = { c->fd, POLLIN, 0 };
+	if (poll(&p, 1, timeout_ms) > 0) {
+		char buf[256];
+		ssize_t n = read(c->fd, buf, sizeof(buf));
+		double now = _now();
+		if ((n < 0) && (errno != EAGAIN) && (errno != EINTR)) return (-1);
+		for (ssize_t i=0; i<n; i++) {
+			c->stats.rx_bytes++;
+			if (buf[i] == '\r') continue;
+			if (buf[i] != '\n') {
+				if (c->rx_len < KCL_LINE_MAX-1) c->rx[c->rx_len++] = buf[i];
+				continue;
+			}
+			c->rx[c->rx_len] = 0;
+			if (c->rx_len > 0) delivered += _match(c, c->rx, now);
+			c->rx_len = 0;
+		}
+	}
+	double now = _now();
+	while ((c->inflight > 0) && (now - c->q[c->head].sent_s > c->timeout_s)) {
+		_retire(c, KCL_TIMEOUT, NULL, now);
+		delivered++;
+	}
+	if (_transmit(c) != 0) return (-1);
+	return (delivered);
+}
+
+/*
+ * kcl_drain() - poll until every request is answered (0) or the time runs out (-1)
+ */
+int kcl_drain(kclClient_t *c, int timeout_ms)
+{
+	double end = _now() + timeout_ms / 1000.0;
+	while (c->count > 0) {
+		int left = (int)((end - _now()) * 1000);
+		if (left <= 0) return (-1);
+		if (kcl_poll(c, (left < 10) ? left : 10) < 0) return (-1);
+	}
+	return (0);
+}
+
+/*
+ * kcl_send() 		- queue a JSON line. Returns 0, or -1 if the line or the queue is full
+ * kcl_get()		- read a token or a group
+ * kcl_set()		- set a token
+ * kcl_broadcast()	- queue a line for all fins. No response
+ */
+static int _queue(kclClient_t *c, const char *json, uint32_t tag, int broadcast)
+{
+	if (c->count >= KCL_QUEUE_MAX) return (-1);
+	kclRequest_t *r = &c->q[(c->head + c->count) % KCL_QUEUE_MAX];
+	int len = snprintf(r->line, KCL_LINE_MAX, "%s%s\n", broadcast ? "\x16" : "", json);
+	if ((len < 0) || (len >= KCL_LINE_MAX)) return (-1);
+	r->len = len;
+	r->tag = tag;
+	if (broadcast) {
+		r->key[0] = 0;
+	} else {
+		_first_key(json, r->key);
+		if (r->key[0] == 0) return (-1);	// nothing to match a response to
+	}
+	c->count++;
+	return (_transmit(c));
+}
+
+int kcl_send(kclClient_t *c, const char *json, uint32_t tag)
+{
+	return (_queue(c, json, tag, 0));
+}
+
+int kcl_get(kclClient_t *c, const char *token, uint32_t tag)
+{
+	char json[KCL_LINE_MAX];
+	snprintf(json, sizeof(json), "{\"%s\":\"\"}", token);
+	return (_queue(c, json, tag, 0));
+}
+
+int kcl_set(kclClient_t *c, const char *token, double value, uint32_t tag)
+{
+	char json[KCL_LINE_MAX];
+	snprintf(json, sizeof(json), "{\"%s\":%g}", token, value);
+	return (_queue(c, json, tag, 0));
+}
+
+int kcl_broadcast(kclClient_t *c, const char *json)
+{
+	return (_queue(c, json, 0, 1));
+}
+
+/*
+ * kcl_get_stats()
+ * kcl_reset_stats()
+ * kcl_latency_percentile() - estimate from the log2 histogram (geometric within a bin)
+ * kcl_print_stats()
+ */
+const kclStats_t *kcl_get_stats(kclClient_t *c) { return (&c->stats);}
+
+void kcl_reset_stats(kclClient_t *c)
+{
+	memset(&c->stats, 0, sizeof(kclStats_t));
+	c->stats.latency_min_us = INFINITY;
+}
+
+double kcl_latency_percentile(kclClient_t *c, double percent)
+{
+	kclStats_t *s = &c->stats;
+	if (s->responses == 0) return (0);
+	double want = s->responses * percent / 100.0;
+	double seen = 0;
+	for (int i=0; i<KCL_HIST_BINS; i++) {
+		if ((s->hist[i] == 0) || (seen + s->hist[i] < want)) {
+			seen += s->hist[i];
+			continue;
+		}
+		double frac = (want - seen) / s->hist[i];
+		double us = pow(2, i + frac);
+		if (us < s->latency_min_us) us = s->latency_min_us;
+		if (us > s->latency_max_us) us = s->latency_max_us;
+		return (us);
+	}
+	return (s->latency_max_us);
+}
+
+void kcl_print_stats(kclClient_t *c, FILE *f)
+{
+	kclStats_t *s = &c->stats;
+	double secs = s->last_s - s->start_s;
+
+	fprintf(f, "requests:    %u\n", s->requests);
+	fprintf(f, "responses:   %u (%u empty)\n", s->responses, s->empty);
+	fprintf(f, "timeouts:    %u\n", s->timeouts);
+	fprintf(f, "lost:        %u\n", s->lost);
+	fprintf(f, "unsolicited: %u\n", s->unsolicited);
+	fprintf(f, "broadcasts:  %u\n", s->broadcasts);
+	fprintf(f, "bytes:       %llu tx, %llu rx\n",
+			(unsigned long long)s->tx_bytes, (unsigned long long)s->rx_bytes);
+	if (s->responses == 0) return;
+	fprintf(f, "latency us:  min %0.0f  avg %0.0f  p50 %0.0f  p99 %0.0f  max %0.0f\n",
+			s->latency_min_us, s->latency_sum_us / s->responses,
+			kcl_latency_percentile(c, 50), kcl_latency_percentile(c, 99), s->latency_max_us);
+	if (secs > 0) {
+		fprintf(f, "throughput:  %0.1f responses/s, %0.0f bytes/s\n",
+				s->responses / secs, (s->tx_bytes + s->rx_bytes) / secs);
+	}
+}
+
+/*
+ * kcl_find_value() - find "key":number anywhere in a response line
+ *
+ *	Works for single values and for members of a group response. The key is
+ *	matched exactly, so "tmp" in an h1 group is found as "tmp", not "h1tmp".
+ */
+int kcl_find_value(const char *line, const char *key, double *value)
+{
+	char pattern[KEY_MAX+4];
+	snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+	const char *p = strstr(line, pattern);
+	if (p == NULL) return (-1);
+
+	char *end;
+	p += strlen(pattern);
+	double v = strtod(p, &end);
+	if (end == p) return (-1);
+	*value = v;
+	return (0);
+}
@@ -0,0 +1,113 @@
+/*
+ * kinen_client.h - host side client for Kinen fins (JSON lines over a tty or pty)
+ * Part of Kinen project
+ *
+ * Copyright (c) 2013 Alden S. Hart Jr.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* --- How it works ---
+ *
+ *	A fin reads one JSON line at a time (js_json_parser()) and answers every line
+ *	with one response line, in order:
+ *
+ *		{"h1tmp":""}		-->	{"r":{"h1tmp":123.456}}
+ *		{"h1set":150}		-->	{"r":{"h1set":150.000}}
+ *		{"h1":""}			-->	{"r":{"h1":{"st":2,"tmp":123.456,...}}}
+ *
+ *	Lines starting with SYN (0x16) are broadcasts and get no response.
+ *
+ *	The client keeps several requests in flight (pipelining). Each request carries
+ *	a caller's tag. Responses come back in request order, so they are matched to
+ *	the oldest outstanding request. The first key in the response is checked
+ *	against the request's key. If it doesn't match, the client skips ahead to the
+ *	request that does and reports the skipped ones as lost, so one dropped line
+ *	can't shift every later answer. Lines that match nothing (e.g. heater
+ *	shutdown messages) are counted as unsolicited.
+ *
+ *	The fin's receive ring is small (32 bytes on the USART, 30 of them usable),
+ *	so the number of request bytes in flight is limited by a window. Requests
+ *	beyond the window are queued in the client and sent as responses come back.
+ *
+ *	All I/O is non-blocking and driven by kcl_poll(). Responses are delivered to
+ *	a callback from inside kcl_poll().
+ */
+#ifndef kinen_client_h
+#define kinen_client_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define KCL_LINE_MAX		256			// longest request or response line
+#define KCL_QUEUE_MAX		256			// requests queued or in flight
+#define KCL_FIN_RX_BUFFER	32			// the fin's USART_RX_BUFFER_SIZE
+#define KCL_WINDOW_BYTES	(KCL_FIN_RX_BUFFER - 2)	// default request bytes in flight. The ring wraps
+										// at size - 1 and keeps one slot free, so 30 fit
+#define KCL_TIMEOUT_MS		1000		// default time allowed for a response
+#define KCL_HIST_BINS		24			// latency histogram bins (log2 of microseconds)
+
+enum kclStatus {
+	KCL_OK = 0,							// response received and matched
+	KCL_EMPTY,							// response had no value (error or unknown token)
+	KCL_TIMEOUT,						// no response within the timeout
+	KCL_LOST							// a later request was answered first
+};
+
+typedef struct kclResponse {			// passed to the response callback
+	uint32_t tag;						// caller's tag given to kcl_send()
+	uint8_t status;						// see kclStatus
+	double latency_us;					// from the request's last byte written to the response LF
+	const char *request;				// request line (without LF)
+	const char *line;					// response line (without LF) or NULL if none
+} kclResponse_t;
+
+typedef void (*kcl_callback_t)(const kclResponse_t *r, void *context);
+
+typedef struct kclStats {
+	uint32_t requests;					// requests written
+	uint32_t responses;					// responses matched (KCL_OK + KCL_EMPTY)
+	uint32_t empty;						// responses with no value
+	uint32_t timeouts;
+	uint32_t lost;
+	uint32_t unsolicited;				// lines that matched no request
+	uint32_t broadcasts;
+	uint64_t tx_bytes;
+	uint64_t rx_bytes;
+	double latency_min_us;
+	double latency_max_us;
+	double latency_sum_us;
+	uint32_t hist[KCL_HIST_BINS];		// bin n counts latencies from 2^n to 2^(n+1) us
+	double start_s;						// time of the first request since the last reset
+	double last_s;						// time of the last response
+} kclStats_t;
+
+typedef struct kclClient kclClient_t;	// opaque
+
+kclClient_t *kcl_open(const char *path, int baud);	// baud is ignored for a pty
+void kcl_close(kclClient_t *c);
+void kcl_set_callback(kclClient_t *c, kcl_callback_t callback, void *context);
+void kcl_set_window(kclClient_t *c, int bytes);
+void kcl_set_timeout(kclClient_t *c, int ms);
+
+int kcl_send(kclClient_t *c, const char *json, uint32_t tag);	// queue a JSON line
+int kcl_get(kclClient_t *c, const char *token, uint32_t tag);	// read a value or a group
+int kcl_set(kclClient_t *c, const char *token, double value, uint32_t tag);
+int kcl_broadcast(kclClient_t *c, const char *json);			// no response expected
+int kcl_poll(kclClient_t *c, int timeout_ms);	// service I/O. Returns responses delivered or -1
+int kcl_drain(kclClient_t *c, int timeout_ms);	// poll until nothing is queued or in flight
+int kcl_outstanding(kclClient_t *c);			// requests queued or in flight
+
+const kclStats_t *kcl_get_stats(kclClient_t *c);
+void kcl_reset_stats(kclClient_t *c);
+void kcl_print_stats(kclClient_t *c, FILE *f);
+double kcl_latency_percentile(kclClient_t *c, double percent);
+
+int kcl_find_value(const char *line, const char *key, double *value);	// 0 if found
+
+#endif